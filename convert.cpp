@@ -0,0 +1,524 @@
+#include "stdafx.h"
+#include "convert.h"
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+// Chunk bytes read at once
+const size_t DEFAULT_CHUNK_SIZE = 4 << 20;
+
+// Chunks waiting in each queue per worker
+const size_t CHUNKS_PER_WORKER = 2;
+
+// Workers allowed per hardware thread: more only add queue memory
+const int MAX_WORKERS_PER_CPU = 4;
+
+/** Piece of the input ending at a line boundary
+ */
+struct Chunk {
+  size_t seq;
+  vector<char> data;
+  string result;
+};
+
+/** Blocking FIFO with limited capacity
+ */
+class ChunkQueue {
+  deque<Chunk*> m_items;
+  size_t m_capacity;
+  bool m_closed;
+  mutex m_lock;
+  condition_variable m_notFull;
+  condition_variable m_notEmpty;
+
+public:
+  explicit ChunkQueue(size_t capacity): m_capacity(capacity), m_closed(false) {}
+
+  void push(Chunk *chunk) {
+    unique_lock<mutex> lock(m_lock);
+    while (m_items.size() >= m_capacity)
+      m_notFull.wait(lock);
+    m_items.push_back(chunk);
+    m_notEmpty.notify_one();
+  }
+
+  // Returns false when the queue is closed and drained
+  bool pop(Chunk *&chunk) {
+    unique_lock<mutex> lock(m_lock);
+    while (m_items.empty() && !m_closed)
+      m_notEmpty.wait(lock);
+    if (m_items.empty()) return false;
+    chunk = m_items.front();
+    m_items.pop_front();
+    m_notFull.notify_one();
+    return true;
+  }
+
+  void close(void) {
+    lock_guard<mutex> lock(m_lock);
+    m_closed = true;
+    m_notEmpty.notify_all();
+  }
+};
+
+/** Reorders processed chunks back to the input order
+ *  Workers running too far ahead of the writer are blocked
+ */
+class OrderedQueue {
+  map<size_t, Chunk*> m_items;
+  size_t m_next;
+  size_t m_window;
+  int m_producers;
+  mutex m_lock;
+  condition_variable m_changed;
+
+public:
+  OrderedQueue(size_t window, int producers):
+    m_next(0), m_window(window), m_producers(producers) {}
+
+  void push(Chunk *chunk) {
+    unique_lock<mutex> lock(m_lock);
+    while (chunk->seq >= m_next + m_window)
+      m_changed.wait(lock);
+    m_items[chunk->seq] = chunk;
+    m_changed.notify_all();
+  }
+
+  // Producer is through with pushing
+  void done(void) {
+    lock_guard<mutex> lock(m_lock);
+    m_producers--;
+    m_changed.notify_all();
+  }
+
+  // Returns false when all producers are done and everything is popped
+  bool pop(Chunk *&chunk) {
+    unique_lock<mutex> lock(m_lock);
+    for (;;) {
+      map<size_t, Chunk*>::iterator it = m_items.find(m_next);
+      if (it != m_items.end()) {
+        chunk = it->second;
+        m_items.erase(it);
+        m_next++;
+        m_changed.notify_all();
+        return true;
+      }
+      if (m_producers == 0) return false;
+      m_changed.wait(lock);
+    }
+  }
+};
+
+/** Converter state shared by the pipeline stages
+ */
+class Converter {
+  const ConvertOptions &m_options;
+  vector<int> m_slots;              // column index -> parser index or -1
+  vector<DateTimeParser> m_parsers;
+  vector<DateTimeParser> m_formatters;
+  ChunkQueue m_parseQueue;
+  OrderedQueue m_writeQueue;
+  bool m_readError;
+
+  void sniff(const Chunk &chunk);
+  void readAll(FILE *input);
+  void work(void);
+  void processChunk(Chunk &chunk) const;
+  void convertCell(int slot, const char *cell, size_t length, string &out) const;
+
+  // Find field of the line (begin, end) by index, end of the field goes to fieldEnd
+  const char* findField(const char *begin, const char *end, int index, const char *&fieldEnd) const;
+
+public:
+  Converter(const ConvertOptions &options, int threads);
+
+  bool run(FILE *input, FILE *output, int threads);
+};
+
+Converter::Converter(const ConvertOptions &options, int threads):
+  m_options(options),
+  m_parseQueue(threads * CHUNKS_PER_WORKER),
+  m_writeQueue(threads * CHUNKS_PER_WORKER * 2, threads),
+  m_readError(false)
+{
+  for (size_t i = 0; i < options.columns.size(); i++) {
+    int column = options.columns[i];
+    if (column < 0) continue;
+    if (column >= static_cast<int>(m_slots.size()))
+      m_slots.resize(column + 1, -1);
+    if (m_slots[column] < 0) {
+      m_slots[column] = static_cast<int>(m_parsers.size());
+      m_parsers.push_back(DateTimeParser());
+      m_formatters.push_back(DateTimeParser(options.layout));
+    }
+  }
+}
+
+const char* Converter::findField(const char *begin, const char *end, int index, const char *&fieldEnd) const {
+  const char *field = begin;
+  for (;;) {
+    const char *next = static_cast<const char*>(memchr(field, m_options.delimiter, end - field));
+    if (index == 0) {
+      fieldEnd = next ? next : end;
+      return field;
+    }
+    if (!next) return nullptr;
+    field = next + 1;
+    index--;
+  }
+}
+
+void Converter::sniff(const Chunk &chunk) {
+  vector<DateTimeSniffer> sniffers(m_parsers.size());
+  const char *p = chunk.data.empty() ? nullptr : &chunk.data[0];
+  const char *end = p + chunk.data.size();
+  bool skip = m_options.header;
+
+  while (p < end) {
+    const char *eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    const char *lineEnd = eol ? eol : end;
+    if (lineEnd > p && lineEnd[-1] == '\r') lineEnd--;
+
+    bool more = false;
+    for (int column = 0; !skip && column < static_cast<int>(m_slots.size()); column++) {
+      int slot = m_slots[column];
+      if (slot < 0) continue;
+      const char *fieldEnd;
+      const char *field = findField(p, lineEnd, column, fieldEnd);
+      if (field) sniffers[slot].sample(field, fieldEnd - field);
+      more |= !sniffers[slot].ready();
+    }
+
+    if (!skip && !more) break;
+    skip = false;
+    p = eol ? eol + 1 : end;
+  }
+
+  for (size_t i = 0; i < sniffers.size(); i++)
+    m_parsers[i] = sniffers[i].getParser();
+}
+
+void Converter::readAll(FILE *input) {
+  size_t chunkSize = m_options.chunkSize > 0 ? m_options.chunkSize : DEFAULT_CHUNK_SIZE;
+  vector<char> carry;
+  size_t seq = 0;
+  bool eof = false;
+
+  while (!eof) {
+    Chunk *chunk = new Chunk();
+    chunk->data.swap(carry);
+
+    // Read until the chunk has a complete line
+    for (;;) {
+      size_t have = chunk->data.size();
+      chunk->data.resize(have + chunkSize);
+      size_t count = fread(&chunk->data[have], 1, chunkSize, input);
+      chunk->data.resize(have + count);
+
+      if (count == 0) {
+        eof = true;
+        m_readError = ferror(input) != 0;
+        break;
+      }
+
+      size_t pos = have + count;
+      while (pos > have && chunk->data[pos - 1] != '\n') pos--;
+      if (pos > have) {
+        carry.assign(chunk->data.begin() + pos, chunk->data.end());
+        chunk->data.resize(pos);
+        break;
+      }
+    }
+
+    if (chunk->data.empty()) {
+      delete chunk;
+      break;
+    }
+
+    chunk->seq = seq++;
+    if (chunk->seq == 0) sniff(*chunk);
+    m_parseQueue.push(chunk);
+  }
+
+  m_parseQueue.close();
+}
+
+void Converter::convertCell(int slot, const char *cell, size_t length, string &out) const {
+  DateTimeParser::Layout layout;
+  DateTime time = m_parsers[slot].parse(cell, length, layout);
+  if (!time.isValid()) {
+    out.append(cell, length);
+    return;
+  }
+
+  if (m_options.utc > 0)
+    time.toUTC();
+  else if (m_options.utc < 0)
+    time.fromUTC();
+
+  if (m_options.shiftMinutes)
+    time.incMinute(m_options.shiftMinutes);
+
+  if (m_options.truncateDay && time.hasTime()) {
+    DateTime::Fields fields = time.getFields();
+    fields.hour = fields.minute = fields.second = fields.millisecond = 0;
+    time.set(fields);
+  }
+
+  // Sniffed layout is only the most common one: kept layouts are per cell,
+  //  so odd cells keep their precision. Years a 4-digit layout can't hold
+  //  leave the cell as is
+  char buffer[DateTimeParser::MAX_LENGTH];
+  size_t written = m_options.keepLayout
+    ? DateTimeParser(layout).format(time, buffer)
+    : m_formatters[slot].format(time, buffer);
+  if (written)
+    out.append(buffer, written);
+  else
+    out.append(cell, length);
+}
+
+void Converter::processChunk(Chunk &chunk) const {
+  const char *p = &chunk.data[0];
+  const char *end = p + chunk.data.size();
+  string &out = chunk.result;
+  out.reserve(chunk.data.size() + chunk.data.size() / 8);
+
+  bool skip = chunk.seq == 0 && m_options.header;
+  int columns = static_cast<int>(m_slots.size());
+
+  while (p < end) {
+    const char *eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    const char *next = eol ? eol + 1 : end;
+    const char *lineEnd = eol ? eol : end;
+    if (lineEnd > p && lineEnd[-1] == '\r') lineEnd--;
+
+    if (skip) {
+      out.append(p, next);
+      skip = false;
+      p = next;
+      continue;
+    }
+
+    const char *field = p;
+    for (int column = 0; ; column++) {
+      const char *fieldEnd = static_cast<const char*>(memchr(field, m_options.delimiter, lineEnd - field));
+      if (!fieldEnd) fieldEnd = lineEnd;
+
+      int slot = column < columns ? m_slots[column] : -1;
+      if (slot >= 0)
+        convertCell(slot, field, fieldEnd - field, out);
+      else
+        out.append(field, fieldEnd);
+
+      if (fieldEnd == lineEnd || column + 1 >= columns) {
+        // The rest of the line is copied as is
+        out.append(fieldEnd, next);
+        break;
+      }
+
+      out += m_options.delimiter;
+      field = fieldEnd + 1;
+    }
+
+    p = next;
+  }
+}
+
+void Converter::work(void) {
+  Chunk *chunk;
+  while (m_parseQueue.pop(chunk)) {
+    processChunk(*chunk);
+    vector<char>().swap(chunk->data);
+    m_writeQueue.push(chunk);
+  }
+  m_writeQueue.done();
+}
+
+bool Converter::run(FILE *input, FILE *output, int threads) {
+  thread reader(&Converter::readAll, this, input);
+
+  vector<thread> workers;
+  for (int i = 0; i < threads; i++)
+    workers.push_back(thread(&Converter::work, this));
+
+  bool result = true;
+  Chunk *chunk;
+  while (m_writeQueue.pop(chunk)) {
+    if (result && !chunk->result.empty())
+      result = fwrite(chunk->result.data(), 1, chunk->result.size(), output) == chunk->result.size();
+    delete chunk;
+  }
+
+  reader.join();
+  for (size_t i = 0; i < workers.size(); i++)
+    workers[i].join();
+
+  return result && !m_readError;
+}
+
+//******************************
+ConvertOptions::ConvertOptions():
+  delimiter(','),
+  keepLayout(true),
+  layout(DateTimeParser::LAYOUT_GENERIC),
+  shiftMinutes(0),
+  utc(0),
+  truncateDay(false),
+  header(false),
+  threads(0),
+  chunkSize(DEFAULT_CHUNK_SIZE)
+{
+  columns.push_back(0);
+}
+
+bool convertStream(const ConvertOptions &options, FILE *input, FILE *output) {
+  int cpus = static_cast<int>(thread::hardware_concurrency());
+  if (cpus <= 0) cpus = 1;
+  int threads = options.threads;
+  if (threads <= 0) threads = cpus;
+  if (threads > cpus * MAX_WORKERS_PER_CPU) threads = cpus * MAX_WORKERS_PER_CPU;
+
+  Converter converter(options, threads);
+  return converter.run(input, output, threads);
+}
+
+//******************************
+const char* const LAYOUT_NAMES[DateTimeParser::LAYOUT_COUNT] = {
+  "sql", "date", "datetime", "datetime-ms", "iso", "iso-ms", "dmy", "dmy-time"
+};
+
+void printUsage(void) {
+  fprintf(stderr,
+    "Usage: datetime convert [options] [file...]\n"
+    "Converts timestamp columns of delimited text, reads stdin if no files given\n"
+    "  -d CHAR      field delimiter (default ','; 'tab' for tab)\n"
+    "  -f LIST      comma-separated 1-based timestamp columns (default 1)\n"
+    "  -o LAYOUT    output layout: sql, date, datetime, datetime-ms, iso, iso-ms,\n"
+    "               dmy, dmy-time (default: same as input)\n"
+    "  -z MINUTES   shift values by the amount of minutes\n"
+    "  -u           convert local time to UTC\n"
+    "  -l           convert UTC to local time\n"
+    "  -t           truncate values to the day\n"
+    "  -H           copy the first line as a header\n"
+    "  -j THREADS   amount of workers (default: CPU count, at most 4 per CPU)\n");
+}
+
+bool parseLayout(const char *name, DateTimeParser::Layout &layout) {
+  for (int i = 0; i < DateTimeParser::LAYOUT_COUNT; i++) {
+    if (strcmp(name, LAYOUT_NAMES[i]) == 0) {
+      layout = static_cast<DateTimeParser::Layout>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool parseNumber(const char *text, long low, long high, int &value) {
+  char *end;
+  long number = strtol(text, &end, 10);
+  if (end == text || *end || number < low || number > high) return false;
+  value = static_cast<int>(number);
+  return true;
+}
+
+bool parseColumns(const char *list, vector<int> &columns) {
+  columns.clear();
+  while (*list) {
+    char *end;
+    long column = strtol(list, &end, 10);
+    if (end == list || column < 1) return false;
+    columns.push_back(static_cast<int>(column - 1));
+    if (*end == ',') end++;
+    else if (*end) return false;
+    list = end;
+  }
+  return !columns.empty();
+}
+
+int runConverter(int argc, char *argv[]) {
+  ConvertOptions options;
+  vector<const char*> files;
+
+  for (int i = 0; i < argc; i++) {
+    string arg(argv[i]);
+    bool hasValue = i + 1 < argc;
+
+    if (arg == "-d" && hasValue) {
+      string value(argv[++i]);
+      if (value == "tab" || value == "\\t")
+        options.delimiter = '\t';
+      else if (value.size() == 1)
+        options.delimiter = value[0];
+      else {
+        printUsage();
+        return 2;
+      }
+    } else if (arg == "-f" && hasValue) {
+      if (!parseColumns(argv[++i], options.columns)) {
+        printUsage();
+        return 2;
+      }
+    } else if (arg == "-o" && hasValue) {
+      if (!parseLayout(argv[++i], options.layout)) {
+        printUsage();
+        return 2;
+      }
+      options.keepLayout = false;
+    } else if (arg == "-z" && hasValue) {
+      if (!parseNumber(argv[++i], -INT_MAX, INT_MAX, options.shiftMinutes)) {
+        printUsage();
+        return 2;
+      }
+    } else if (arg == "-j" && hasValue) {
+      if (!parseNumber(argv[++i], 1, INT_MAX, options.threads)) {
+        printUsage();
+        return 2;
+      }
+    } else if (arg == "-u") {
+      options.utc = 1;
+    } else if (arg == "-l") {
+      options.utc = -1;
+    } else if (arg == "-t") {
+      options.truncateDay = true;
+    } else if (arg == "-H") {
+      options.header = true;
+    } else if (arg == "-" || arg[0] != '-') {
+      files.push_back(argv[i]);
+    } else {
+      printUsage();
+      return 2;
+    }
+  }
+
+  if (files.empty()) files.push_back("-");
+
+  int result = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    bool isStdin = strcmp(files[i], "-") == 0;
+    FILE *input = isStdin ? stdin : fopen(files[i], "rb");
+    if (!input) {
+      fprintf(stderr, "datetime: can't open %s\n", files[i]);
+      result = 1;
+      continue;
+    }
+
+    if (!convertStream(options, input, stdout)) {
+      fprintf(stderr, "datetime: error converting %s\n", isStdin ? "stdin" : files[i]);
+      result = 1;
+    }
+
+    if (!isStdin) fclose(input);
+  }
+
+  if (fflush(stdout) != 0) result = 1;
+  return result;
+}
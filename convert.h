@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdio>
+#include <vector>
+#include "sniffer.h"
+
+/** Settings of the timestamp column converter
+ */
+struct ConvertOptions {
+  char delimiter;                   // field separator
+  std::vector<int> columns;         // zero-based indices of the timestamp columns
+  bool keepLayout;                  // write every value in the layout it was read (SQL for odd ones)
+  DateTimeParser::Layout layout;    // output layout unless keepLayout is set
+  int shiftMinutes;                 // shift values by this amount of minutes
+  int utc;                          // 1 - convert to UTC, -1 - convert from UTC, 0 - leave as is
+  bool truncateDay;                 // drop the time portion
+  bool header;                      // the first line is a header to be copied as is
+  int threads;                      // amount of parse/format workers, 0 - CPU count (at most 4 per CPU)
+  size_t chunkSize;                 // bytes read at once
+
+  ConvertOptions();
+};
+
+/** Convert timestamp columns of a delimited text stream
+ *  The stream goes through read -> parse/transform/format -> write stages
+ *   connected with bounded queues. Chunks are processed by parallel workers
+ *   and written in the original order.
+ *  Cells which can't be parsed or whose result has a year out of 1-9999 are
+ *  copied unchanged. Quoted fields are not supported.
+ * /param options       Conversion settings
+ * /param input         Stream to read from
+ * /param output        Stream to write to
+ * /result              False on read or write errors
+ */
+bool convertStream(const ConvertOptions &options, FILE *input, FILE *output);
+
+/** Command line entry of the converter
+ * /param argc          Amount of arguments following the "convert" command
+ * /param argv          The arguments
+ * /result              Process exit code
+ */
+int runConverter(int argc, char *argv[]);
@@ -1,4 +1,4 @@
-#include "StdAfx.h"
+#include "stdafx.h"
 #include "date.h"
 #include <sstream>
 #include <iomanip>
@@ -25,6 +25,9 @@ const long long TIME_T_ZERO = 62167132800000;
 const int MONTH_LENGTHS[]      =     {31, 28, 31, 30,   31,  30,  31,  31,  30,  31,  30,  31};
 const int MONTH_LENGTHS_LEAP[] =     {31, 29, 31, 30,   31,  30,  31,  31,  30,  31,  30,  31};
 
+// Latest year m_time holds without overflow (with a margin)
+const int MAX_YEAR = 290000000;
+
 const int MONTH_STARTS[]       = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365};
 
 // Spare day of the leap year counted in the leap-year-days
@@ -41,7 +44,11 @@ long long getTimezone(void) {
     // Point is converting current time_t to UTC in struct tm, then back to localtime
     time_t t = time(nullptr);
     tm utc;
+#ifdef WIN32
     if (gmtime_s(&utc, &t) == 0) {
+#else
+    if (gmtime_r(&t, &utc)) {
+#endif
       // Unknown state of daylight saving (supposing the state is not
       // changing while the application works):
       utc.tm_isdst = -1;
@@ -91,6 +98,7 @@ public:
   STime(long long time);
   STime(const tm *time);
   STime(const string &value);
+  STime(const DateTime::Fields &fields);
 
   // Get amount of milliseconds from J1n, 1 of the 1'th year
   long long get(void);
@@ -116,6 +124,9 @@ public:
 
   // Get STime in representation of struct tm
   void asTime(tm *time);
+
+  // Get STime as DateTime calendar fields
+  void asFields(DateTime::Fields *fields) const;
 };
 
 STime::STime():
@@ -181,6 +192,26 @@ STime::STime(const string &value) {
   month--;
 }
 
+STime::STime(const DateTime::Fields &fields):
+  year(fields.year),
+  month(fields.month - 1),
+  day(fields.day),
+  hour(fields.hour),
+  minute(fields.minute),
+  second(fields.second),
+  millisecond(fields.millisecond)
+{
+  valid = fields.valid
+    && year >= 1 && year <= MAX_YEAR
+    && month >= 0 && month < MONTH_COUNT
+    && day > 0
+    && day <= (isLeap(year) ? MONTH_LENGTHS_LEAP : MONTH_LENGTHS)[month]
+    && hour >= 0 && hour < 24
+    && minute >= 0 && minute < 60
+    && second >= 0 && second < 60
+    && millisecond >= 0 && millisecond < TIME_MULTIPLIER;
+}
+
 STime::STime (long long time): valid(true) {
   millisecond = time % TIME_MULTIPLIER;
   // Milliseconds ingnored
@@ -339,6 +370,17 @@ void STime::asTime(tm *time) {
   time->tm_sec = second;
 }
 
+void STime::asFields(DateTime::Fields *fields) const {
+  fields->year = year;
+  fields->month = month + 1;
+  fields->day = day;
+  fields->hour = hour;
+  fields->minute = minute;
+  fields->second = second;
+  fields->millisecond = millisecond;
+  fields->valid = valid;
+}
+
 //******************************
 DateTime::DateTime () {
   // Invalid date-time by default
@@ -387,6 +429,10 @@ long long DateTime::getRaw(void) const {
   return m_time;
 }
 
+void DateTime::setRaw(long long value) {
+  m_time = value;
+}
+
 void DateTime::toUTC(void) {
   if (m_time != LLONG_MIN)
     m_time += getTimezone();
@@ -443,6 +489,11 @@ void DateTime::set (const tm *time) {
   m_time = t.get();
 }
 
+void DateTime::set (const Fields &fields) {
+  STime t(fields);
+  m_time = t.get();
+}
+
 DateTime& DateTime::incSecond(int seconds) {
   if (m_time != LLONG_MIN)
     m_time += (long long) seconds * TIME_MULTIPLIER;
@@ -498,6 +549,57 @@ int DateTime::getDayOfYear(void) const {
   return time.dayOfYear();
 }
 
+DateTime::Fields DateTime::getFields(void) const {
+  Fields result;
+  if (m_time == LLONG_MIN) {
+    memset(&result, 0, sizeof(Fields));
+    result.valid = false;
+  } else {
+    STime time(m_time);
+    time.asFields(&result);
+  }
+  return result;
+}
+
+int DateTime::getYear(void) const {
+  if (m_time == LLONG_MIN) return -1;
+  return getFields().year;
+}
+
+int DateTime::getMonth(void) const {
+  if (m_time == LLONG_MIN) return -1;
+  return getFields().month;
+}
+
+int DateTime::getDay(void) const {
+  if (m_time == LLONG_MIN) return -1;
+  return getFields().day;
+}
+
+int DateTime::getHour(void) const {
+  if (m_time == LLONG_MIN) return -1;
+  return static_cast<int>(m_time % MILLISECS_IN_DAY / (SECS_IN_HOUR * TIME_MULTIPLIER));
+}
+
+int DateTime::getMinute(void) const {
+  if (m_time == LLONG_MIN) return -1;
+  return static_cast<int>(m_time % (SECS_IN_HOUR * TIME_MULTIPLIER) / (SECS_IN_MINUTE * TIME_MULTIPLIER));
+}
+
+int DateTime::getSecond(void) const {
+  if (m_time == LLONG_MIN) return -1;
+  return static_cast<int>(m_time % (SECS_IN_MINUTE * TIME_MULTIPLIER) / TIME_MULTIPLIER);
+}
+
+int DateTime::getMillisecond(void) const {
+  if (m_time == LLONG_MIN) return -1;
+  return static_cast<int>(m_time % TIME_MULTIPLIER);
+}
+
+bool DateTime::isLeapYear(int year) {
+  return isLeap(year);
+}
+
 int DateTime::daysBetween(const DateTime &date1, const DateTime &date2) {
   if (date1.m_time == LLONG_MIN || date2.m_time == LLONG_MIN) return -1;
   long long diff = date1.m_time - date2.m_time;
@@ -16,6 +16,21 @@ class DateTime {
   long long m_time;
 
 public:
+  /** Date and time split into calendar fields
+   *  Filled by a single decomposition of the value, so reading several
+   *  calendar fields costs no more than reading one
+   */
+  struct Fields {
+    int year;
+    int month;        // 1 - 12
+    int day;          // 1 - 31
+    int hour;
+    int minute;
+    int second;
+    int millisecond;
+    bool valid;
+  };
+
   /** Default constructor. Sets the instance to invalid date and time
    */
   DateTime ();
@@ -57,6 +72,11 @@ public:
    */
   long long getRaw(void) const;
 
+  /** Set raw date and time value
+   * /param value     Milliseconds from Jan, 1 of the 1'st year (LLONG_MIN for invalid)
+   */
+  void setRaw(long long value);
+
   /** Convert local datetime value to UTC
    *  DateTime doesn't keep timezone for current value,
    *   caller should track it by itself
@@ -105,6 +125,12 @@ public:
    */
   void set (const tm *time);
 
+  /** Set date and time
+   * /param fields    Calendar fields; the value becomes invalid if fields.valid is false
+   *                  or any field is out of its range (year from 1, real month lengths)
+   */
+  void set (const Fields &fields);
+
 
   /* Get formatted date
    * /result          Date in SQL-format (yyyy-MM-dd) or empty string for invalid dates
@@ -163,6 +189,46 @@ public:
    */
   int getDayOfYear(void) const;
 
+  /** Get all calendar fields at once
+   * /result      Decomposed date and time, Fields::valid is false for the invalid value
+   */
+  Fields getFields(void) const;
+
+  /** Get year of the date
+   * /result      Year of a valid date or -1
+   */
+  int getYear(void) const;
+
+  /** Get month of the date
+   * /result      Month of a valid date (1 for Jan, 12 for Dec) or -1
+   */
+  int getMonth(void) const;
+
+  /** Get day of the month
+   * /result      Day of the month of a valid date (1 - 31) or -1
+   */
+  int getDay(void) const;
+
+  /** Get hour of the day
+   * /result      Hour of a valid date-time (0 - 23) or -1
+   */
+  int getHour(void) const;
+
+  /** Get minute of the hour
+   * /result      Minute of a valid date-time (0 - 59) or -1
+   */
+  int getMinute(void) const;
+
+  /** Get second of the minute
+   * /result      Second of a valid date-time (0 - 59) or -1
+   */
+  int getSecond(void) const;
+
+  /** Get millisecond of the second
+   * /result      Millisecond of a valid date-time (0 - 999) or -1
+   */
+  int getMillisecond(void) const;
+
   /** Get amount of days between two DateTime values
    * /param date1       First date
    * /param date2       Second date
@@ -184,6 +250,10 @@ public:
    */
   static int yearsBetween(const DateTime &date1, const DateTime &date2);
 
+  /** Check if the year is leap (Gregorian)
+   */
+  static bool isLeapYear(int year);
+
   /** This value differs from the provided one not more then by a minute?
    */
   bool identic(const DateTime &other) const;
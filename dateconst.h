@@ -0,0 +1,25 @@
+#pragma once
+
+/** Internal constants and helpers shared by the modules working on raw
+ *  DateTime::m_time values (milliseconds since the start of the 1'st year)
+ */
+
+const long long MILLISECS_IN_SECOND = 1000;
+const long long MILLISECS_IN_MINUTE = MILLISECS_IN_SECOND * 60;
+const long long MILLISECS_IN_HOUR = MILLISECS_IN_MINUTE * 60;
+const long long MILLISECS_IN_DAY = MILLISECS_IN_HOUR * 24;
+
+// Sign bit flip makes raw times order as unsigned numbers, LLONG_MIN becomes 0
+const unsigned long long SIGN_BIT = 1ULL << 63;
+
+/** Raw time as an unsigned key of the same order
+ */
+inline unsigned long long toKey(long long raw) {
+  return static_cast<unsigned long long>(raw) ^ SIGN_BIT;
+}
+
+/** Raw time of a key made by toKey()
+ */
+inline long long fromKey(unsigned long long key) {
+  return static_cast<long long>(key ^ SIGN_BIT);
+}
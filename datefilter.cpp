@@ -0,0 +1,417 @@
+#include "stdafx.h"
+#include "datefilter.h"
+#include "dateconst.h"
+#include <climits>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define FILTER_X86_KERNELS
+  #include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Kernels read DateTime arrays as raw m_time values
+static_assert(sizeof(DateTime) == sizeof(long long), "DateTime must hold m_time only");
+
+/** Kernels take the range as its low end and length:
+ *  a value matches if (value - low) < span as unsigned numbers
+ */
+struct FilterKernels {
+  DateTimeFilter::Kernel kernel;
+  size_t (*count)(const long long *values, size_t count, unsigned long long low, unsigned long long span);
+  size_t (*bitmap)(const long long *values, size_t count, unsigned long long low, unsigned long long span,
+    unsigned long long *bitmap);
+  size_t (*indices)(const long long *values, size_t count, unsigned long long low, unsigned long long span,
+    size_t *indices);
+  size_t (*minMax)(const long long *values, size_t count, long long &least, long long &greatest);
+};
+
+inline const long long* rawValues(const DateTime *values) {
+  return reinterpret_cast<const long long*>(values);
+}
+
+inline bool matches(long long value, unsigned long long low, unsigned long long span) {
+  return static_cast<unsigned long long>(value) - low < span;
+}
+
+/** Turn [from, to) into low end and length
+ *  The low end is above LLONG_MIN so invalid values never match
+ * /result    False if the range is empty
+ */
+inline bool makeRange(const DateTime &from, const DateTime &to, unsigned long long &low, unsigned long long &span) {
+  long long first = from.getRaw();
+  if (first == LLONG_MIN) first = LLONG_MIN + 1;
+  long long last = to.getRaw();
+  if (last <= first) return false;
+
+  low = static_cast<unsigned long long>(first);
+  span = static_cast<unsigned long long>(last) - low;
+  return true;
+}
+
+/** Expand a word of the bitmap into indices
+ */
+inline size_t expandWord(unsigned long long word, size_t base, size_t *indices) {
+  size_t result = 0;
+  while (word) {
+#ifdef __GNUC__
+    int bit = __builtin_ctzll(word);
+#else
+    int bit = 0;
+    while (!((word >> bit) & 1)) bit++;
+#endif
+    indices[result++] = base + bit;
+    word &= word - 1;
+  }
+  return result;
+}
+
+//******************************
+// Scalar kernels
+
+size_t countScalar(const long long *values, size_t count, unsigned long long low, unsigned long long span) {
+  size_t result = 0;
+  for (size_t i = 0; i < count; i++)
+    result += matches(values[i], low, span);
+  return result;
+}
+
+size_t bitmapScalar(const long long *values, size_t count, unsigned long long low, unsigned long long span,
+  unsigned long long *bitmap)
+{
+  size_t result = 0;
+  for (size_t start = 0; start < count; start += 64) {
+    size_t end = count - start < 64 ? count : start + 64;
+    unsigned long long word = 0;
+    for (size_t i = start; i < end; i++)
+      word |= static_cast<unsigned long long>(matches(values[i], low, span)) << (i - start);
+    bitmap[start / 64] = word;
+    result += countScalar(values + start, end - start, low, span);
+  }
+  return result;
+}
+
+size_t indicesScalar(const long long *values, size_t count, unsigned long long low, unsigned long long span,
+  size_t *indices)
+{
+  // Branch-free: the index is always written, the position advances on a match
+  size_t result = 0;
+  for (size_t i = 0; i < count; i++) {
+    indices[result] = i;
+    result += matches(values[i], low, span);
+  }
+  return result;
+}
+
+size_t minMaxScalar(const long long *values, size_t count, long long &least, long long &greatest) {
+  size_t invalid = 0;
+  least = LLONG_MAX;
+  greatest = LLONG_MIN;
+  for (size_t i = 0; i < count; i++) {
+    long long value = values[i];
+    bool isInvalid = value == LLONG_MIN;
+    invalid += isInvalid;
+    long long candidate = isInvalid ? LLONG_MAX : value;
+    least = candidate < least ? candidate : least;
+    greatest = value > greatest ? value : greatest;
+  }
+  return count - invalid;
+}
+
+const FilterKernels SCALAR_KERNELS = {
+  DateTimeFilter::KERNEL_SCALAR, countScalar, bitmapScalar, indicesScalar, minMaxScalar
+};
+
+#ifdef FILTER_X86_KERNELS
+//******************************
+// AVX2 kernels: no unsigned 64-bit compare, so both sides get the sign bit flipped
+
+__attribute__((target("avx2")))
+inline __m256i matchesAvx2(__m256i values, __m256i low, __m256i span) {
+  __m256i sign = _mm256_set1_epi64x(static_cast<long long>(SIGN_BIT));
+  __m256i offset = _mm256_xor_si256(_mm256_sub_epi64(values, low), sign);
+  return _mm256_cmpgt_epi64(span, offset);
+}
+
+__attribute__((target("avx2")))
+size_t countAvx2(const long long *values, size_t count, unsigned long long low, unsigned long long span) {
+  __m256i vlow = _mm256_set1_epi64x(static_cast<long long>(low));
+  __m256i vspan = _mm256_set1_epi64x(static_cast<long long>(span ^ SIGN_BIT));
+  __m256i sum1 = _mm256_setzero_si256();
+  __m256i sum2 = _mm256_setzero_si256();
+
+  // Matches are -1: subtracting them counts
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i + 4));
+    sum1 = _mm256_sub_epi64(sum1, matchesAvx2(a, vlow, vspan));
+    sum2 = _mm256_sub_epi64(sum2, matchesAvx2(b, vlow, vspan));
+  }
+
+  long long lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), _mm256_add_epi64(sum1, sum2));
+  return static_cast<size_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3])
+    + countScalar(values + i, count - i, low, span);
+}
+
+__attribute__((target("avx2")))
+size_t bitmapAvx2(const long long *values, size_t count, unsigned long long low, unsigned long long span,
+  unsigned long long *bitmap)
+{
+  __m256i vlow = _mm256_set1_epi64x(static_cast<long long>(low));
+  __m256i vspan = _mm256_set1_epi64x(static_cast<long long>(span ^ SIGN_BIT));
+  size_t result = 0;
+
+  size_t start = 0;
+  for (; start + 64 <= count; start += 64) {
+    unsigned long long word = 0;
+    for (int group = 0; group < 16; group++) {
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + start + group * 4));
+      unsigned long long bits = _mm256_movemask_pd(_mm256_castsi256_pd(matchesAvx2(a, vlow, vspan)));
+      word |= bits << (group * 4);
+    }
+    bitmap[start / 64] = word;
+    result += __builtin_popcountll(word);
+  }
+
+  if (start < count)
+    result += bitmapScalar(values + start, count - start, low, span, bitmap + start / 64);
+  return result;
+}
+
+__attribute__((target("avx2")))
+size_t indicesAvx2(const long long *values, size_t count, unsigned long long low, unsigned long long span,
+  size_t *indices)
+{
+  size_t result = 0;
+  for (size_t start = 0; start < count; start += 64) {
+    size_t length = count - start < 64 ? count - start : 64;
+    unsigned long long word;
+    bitmapAvx2(values + start, length, low, span, &word);
+    result += expandWord(word, start, indices + result);
+  }
+  return result;
+}
+
+__attribute__((target("avx2")))
+size_t minMaxAvx2(const long long *values, size_t count, long long &least, long long &greatest) {
+  __m256i invalid = _mm256_set1_epi64x(LLONG_MIN);
+  __m256i maximum = _mm256_set1_epi64x(LLONG_MAX);
+  __m256i vmin = maximum;
+  __m256i vmax = invalid;
+  __m256i invalids = _mm256_setzero_si256();
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+    __m256i isInvalid = _mm256_cmpeq_epi64(a, invalid);
+    invalids = _mm256_sub_epi64(invalids, isInvalid);
+
+    // Invalid values are LLONG_MIN: they never win the maximum, and are replaced for the minimum
+    __m256i candidate = _mm256_blendv_epi8(a, maximum, isInvalid);
+    vmin = _mm256_blendv_epi8(vmin, candidate, _mm256_cmpgt_epi64(vmin, candidate));
+    vmax = _mm256_blendv_epi8(vmax, a, _mm256_cmpgt_epi64(a, vmax));
+  }
+
+  long long mins[4], maxs[4], counts[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(mins), vmin);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(maxs), vmax);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(counts), invalids);
+
+  size_t valid = minMaxScalar(values + i, count - i, least, greatest);
+  for (int lane = 0; lane < 4; lane++) {
+    if (mins[lane] < least) least = mins[lane];
+    if (maxs[lane] > greatest) greatest = maxs[lane];
+  }
+  return valid + i - static_cast<size_t>(counts[0] + counts[1] + counts[2] + counts[3]);
+}
+
+const FilterKernels AVX2_KERNELS = {
+  DateTimeFilter::KERNEL_AVX2, countAvx2, bitmapAvx2, indicesAvx2, minMaxAvx2
+};
+
+//******************************
+// AVX-512 kernels: unsigned compares and masked loads for the tails
+
+inline __mmask8 tailMask(size_t count) {
+  return static_cast<__mmask8>((1u << count) - 1);
+}
+
+__attribute__((target("avx512f")))
+size_t countAvx512(const long long *values, size_t count, unsigned long long low, unsigned long long span) {
+  __m512i vlow = _mm512_set1_epi64(static_cast<long long>(low));
+  __m512i vspan = _mm512_set1_epi64(static_cast<long long>(span));
+  size_t result = 0;
+
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m512i a = _mm512_loadu_si512(values + i);
+    result += __builtin_popcount(_mm512_cmplt_epu64_mask(_mm512_sub_epi64(a, vlow), vspan));
+  }
+
+  if (i < count) {
+    __mmask8 tail = tailMask(count - i);
+    __m512i a = _mm512_maskz_loadu_epi64(tail, values + i);
+    result += __builtin_popcount(_mm512_mask_cmplt_epu64_mask(tail, _mm512_sub_epi64(a, vlow), vspan));
+  }
+  return result;
+}
+
+__attribute__((target("avx512f")))
+size_t bitmapAvx512(const long long *values, size_t count, unsigned long long low, unsigned long long span,
+  unsigned long long *bitmap)
+{
+  __m512i vlow = _mm512_set1_epi64(static_cast<long long>(low));
+  __m512i vspan = _mm512_set1_epi64(static_cast<long long>(span));
+  size_t result = 0;
+
+  for (size_t start = 0; start < count; start += 64) {
+    unsigned long long word = 0;
+    for (size_t group = 0; group < 8 && start + group * 8 < count; group++) {
+      size_t offset = start + group * 8;
+      __mmask8 tail = count - offset < 8 ? tailMask(count - offset) : 0xFF;
+      __m512i a = _mm512_maskz_loadu_epi64(tail, values + offset);
+      unsigned long long bits = _mm512_mask_cmplt_epu64_mask(tail, _mm512_sub_epi64(a, vlow), vspan);
+      word |= bits << (group * 8);
+    }
+    bitmap[start / 64] = word;
+    result += __builtin_popcountll(word);
+  }
+  return result;
+}
+
+__attribute__((target("avx512f")))
+size_t indicesAvx512(const long long *values, size_t count, unsigned long long low, unsigned long long span,
+  size_t *indices)
+{
+  if (sizeof(size_t) != sizeof(long long))
+    return indicesScalar(values, count, low, span, indices);
+
+  __m512i vlow = _mm512_set1_epi64(static_cast<long long>(low));
+  __m512i vspan = _mm512_set1_epi64(static_cast<long long>(span));
+  __m512i positions = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+  __m512i step = _mm512_set1_epi64(8);
+  size_t result = 0;
+
+  // Matching positions are packed to the output
+  for (size_t i = 0; i < count; i += 8) {
+    __mmask8 tail = count - i < 8 ? tailMask(count - i) : 0xFF;
+    __m512i a = _mm512_maskz_loadu_epi64(tail, values + i);
+    __mmask8 match = _mm512_mask_cmplt_epu64_mask(tail, _mm512_sub_epi64(a, vlow), vspan);
+    _mm512_mask_compressstoreu_epi64(indices + result, match, positions);
+    result += __builtin_popcount(match);
+    positions = _mm512_add_epi64(positions, step);
+  }
+  return result;
+}
+
+__attribute__((target("avx512f")))
+size_t minMaxAvx512(const long long *values, size_t count, long long &least, long long &greatest) {
+  __m512i invalid = _mm512_set1_epi64(LLONG_MIN);
+  __m512i vmin = _mm512_set1_epi64(LLONG_MAX);
+  __m512i vmax = invalid;
+  size_t valid = 0;
+
+  for (size_t i = 0; i < count; i += 8) {
+    __mmask8 tail = count - i < 8 ? tailMask(count - i) : 0xFF;
+    __m512i a = _mm512_maskz_loadu_epi64(tail, values + i);
+    __mmask8 isValid = _mm512_mask_cmpneq_epi64_mask(tail, a, invalid);
+    vmin = _mm512_mask_min_epi64(vmin, isValid, vmin, a);
+    vmax = _mm512_mask_max_epi64(vmax, isValid, vmax, a);
+    valid += __builtin_popcount(isValid);
+  }
+
+  long long mins[8], maxs[8];
+  _mm512_storeu_si512(mins, vmin);
+  _mm512_storeu_si512(maxs, vmax);
+
+  least = LLONG_MAX;
+  greatest = LLONG_MIN;
+  for (int lane = 0; lane < 8; lane++) {
+    if (mins[lane] < least) least = mins[lane];
+    if (maxs[lane] > greatest) greatest = maxs[lane];
+  }
+  return valid;
+}
+
+const FilterKernels AVX512_KERNELS = {
+  DateTimeFilter::KERNEL_AVX512, countAvx512, bitmapAvx512, indicesAvx512, minMaxAvx512
+};
+#endif
+
+//******************************
+const FilterKernels* bestKernels(void) {
+#ifdef FILTER_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return &AVX512_KERNELS;
+  if (__builtin_cpu_supports("avx2")) return &AVX2_KERNELS;
+#endif
+  return &SCALAR_KERNELS;
+}
+
+const FilterKernels* kernels = bestKernels();
+
+DateTimeFilter::Kernel DateTimeFilter::getKernel(void) {
+  return kernels->kernel;
+}
+
+bool DateTimeFilter::setKernel(Kernel kernel) {
+  if (kernel == KERNEL_SCALAR) {
+    kernels = &SCALAR_KERNELS;
+    return true;
+  }
+
+#ifdef FILTER_X86_KERNELS
+  if (kernel == KERNEL_AVX2 && __builtin_cpu_supports("avx2")) {
+    kernels = &AVX2_KERNELS;
+    return true;
+  }
+  if (kernel == KERNEL_AVX512 && __builtin_cpu_supports("avx512f")) {
+    kernels = &AVX512_KERNELS;
+    return true;
+  }
+#endif
+
+  return false;
+}
+
+size_t DateTimeFilter::count(const DateTime *values, size_t count, const DateTime &from, const DateTime &to) {
+  unsigned long long low, span;
+  if (!makeRange(from, to, low, span)) return 0;
+  return kernels->count(rawValues(values), count, low, span);
+}
+
+size_t DateTimeFilter::select(const DateTime *values, size_t count, const DateTime &from, const DateTime &to,
+  unsigned long long *bitmap)
+{
+  unsigned long long low, span;
+  if (!makeRange(from, to, low, span)) {
+    memset(bitmap, 0, (count + 63) / 64 * sizeof(unsigned long long));
+    return 0;
+  }
+  return kernels->bitmap(rawValues(values), count, low, span, bitmap);
+}
+
+size_t DateTimeFilter::selectIndices(const DateTime *values, size_t count, const DateTime &from, const DateTime &to,
+  size_t *indices)
+{
+  unsigned long long low, span;
+  if (!makeRange(from, to, low, span)) return 0;
+  return kernels->indices(rawValues(values), count, low, span, indices);
+}
+
+size_t DateTimeFilter::minMax(const DateTime *values, size_t count, DateTime &least, DateTime &greatest) {
+  long long low, high;
+  size_t result = kernels->minMax(rawValues(values), count, low, high);
+
+  if (result) {
+    least.setRaw(low);
+    greatest.setRaw(high);
+  } else {
+    least = DateTime();
+    greatest = DateTime();
+  }
+  return result;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include "date.h"
+
+/** Range filters and aggregates over unsorted DateTime arrays
+ *  Work on raw m_time values with AVX-512 or AVX2 kernels chosen at run
+ *  time (GCC/Clang on x86), a scalar loop otherwise.
+ *  Invalid values never match a range and are skipped by minMax().
+ */
+class DateTimeFilter {
+public:
+  /** Kernel sets
+   */
+  enum Kernel {
+    KERNEL_SCALAR,
+    KERNEL_AVX2,
+    KERNEL_AVX512
+  };
+
+  /** Get kernel set in use
+   */
+  static Kernel getKernel(void);
+
+  /** Use another kernel set (e.g. for testing). Not thread-safe
+   * /result            False if the CPU doesn't support it
+   */
+  static bool setKernel(Kernel kernel);
+
+  /** Count values within [from, to)
+   */
+  static size_t count(const DateTime *values, size_t count, const DateTime &from, const DateTime &to);
+
+  /** Mark values within [from, to)
+   * /param bitmap      Accepts (count + 63) / 64 words, bit i % 64 of word i / 64 is set for a match
+   * /result            Amount of matches
+   */
+  static size_t select(const DateTime *values, size_t count, const DateTime &from, const DateTime &to,
+    unsigned long long *bitmap);
+
+  /** List indices of values within [from, to)
+   * /param indices     Accepts up to count indices in increasing order
+   * /result            Amount of matches
+   */
+  static size_t selectIndices(const DateTime *values, size_t count, const DateTime &from, const DateTime &to,
+    size_t *indices);
+
+  /** Find the least and the greatest valid values
+   * /param least       Accepts the least value (invalid if there are no valid values)
+   * /param greatest    Accepts the greatest value (invalid if there are no valid values)
+   * /result            Amount of valid values
+   */
+  static size_t minMax(const DateTime *values, size_t count, DateTime &least, DateTime &greatest);
+};
@@ -0,0 +1,207 @@
+#include "stdafx.h"
+#include "dateindex.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+#if defined(__GNUC__)
+  #define PREFETCH(address) __builtin_prefetch(address)
+#elif defined(_MSC_VER)
+  #include <xmmintrin.h>
+  #define PREFETCH(address) _mm_prefetch(reinterpret_cast<const char*>(address), _MM_HINT_T0)
+#else
+  #define PREFETCH(address)
+#endif
+
+using namespace std;
+
+// Node k has its descendants 3 levels below at k * 8 .. k * 8 + 7:
+//  one cache line of 8-byte keys, as the key array starts at a line boundary
+const int PREFETCH_SHIFT = 3;
+
+const size_t CACHE_LINE = 64;
+const size_t LINE_KEYS = CACHE_LINE / sizeof(long long);
+
+// Searches interleaved by the batched lookups
+const size_t SEARCH_GROUP = 16;
+
+/** Amount of trailing 1 bits
+ */
+inline int trailingOnes(size_t value) {
+#ifdef __GNUC__
+  return __builtin_ctzll(~static_cast<unsigned long long>(value));
+#else
+  int result = 0;
+  while (value & 1) {
+    value >>= 1;
+    result++;
+  }
+  return result;
+#endif
+}
+
+/** Undo the right turns made after the last left one
+ *  The search goes left at the answer and right ever after, so the
+ *  answer is k without its trailing 1 bits and the last 0 bit
+ */
+inline size_t answerNode(size_t k) {
+  return k >> (trailingOnes(k) + 1);
+}
+
+DateTimeIndex::DateTimeIndex():
+  m_size(0),
+  m_depth(0)
+{
+  allocate(0);
+  m_ranks.push_back(0);
+}
+
+DateTimeIndex::DateTimeIndex(const DateTime *values, size_t count) {
+  build(values, count);
+}
+
+DateTimeIndex::DateTimeIndex(const DateTimeIndex &other):
+  m_ranks(other.m_ranks),
+  m_size(other.m_size),
+  m_depth(other.m_depth)
+{
+  allocate(m_size);
+  copy(other.m_keys, other.m_keys + m_size + 1, m_keys);
+}
+
+const DateTimeIndex& DateTimeIndex::operator= (const DateTimeIndex &other) {
+  if (this != &other) {
+    m_ranks = other.m_ranks;
+    m_size = other.m_size;
+    m_depth = other.m_depth;
+    allocate(m_size);
+    copy(other.m_keys, other.m_keys + m_size + 1, m_keys);
+  }
+  return *this;
+}
+
+void DateTimeIndex::allocate(size_t count) {
+  // A vector gives 8 or 16-byte alignment: take a line more and skip to its boundary
+  m_storage.assign(count + LINE_KEYS, LLONG_MIN);
+  uintptr_t address = reinterpret_cast<uintptr_t>(&m_storage[0]);
+  size_t skip = (CACHE_LINE - address % CACHE_LINE) % CACHE_LINE / sizeof(long long);
+  m_keys = &m_storage[skip];
+}
+
+void DateTimeIndex::place(const DateTime *values, size_t &next, size_t k) {
+  // In-order walk of the implicit tree visits the nodes in sorted order
+  if (k > m_size) return;
+  place(values, next, 2 * k);
+  m_keys[k] = values[next].getRaw();
+  m_ranks[k] = static_cast<unsigned int>(next);
+  next++;
+  place(values, next, 2 * k + 1);
+}
+
+void DateTimeIndex::build(const DateTime *values, size_t count) {
+  if (count > UINT_MAX) count = UINT_MAX;
+
+  m_size = count;
+  allocate(count);
+  m_ranks.assign(count + 1, 0);
+  m_ranks[0] = static_cast<unsigned int>(count);
+
+  size_t next = 0;
+  place(values, next, 1);
+
+  m_depth = 0;
+  while ((static_cast<size_t>(2) << m_depth) - 1 <= count)
+    m_depth++;
+}
+
+size_t DateTimeIndex::size(void) const {
+  return m_size;
+}
+
+size_t DateTimeIndex::search(long long key) const {
+  const long long *keys = m_keys;
+  size_t k = 1;
+
+  // Complete levels: no bounds checks
+  for (int level = 0; level < m_depth; level++) {
+    PREFETCH(keys + (k << PREFETCH_SHIFT));
+    k = 2 * k + (keys[k] < key);
+  }
+
+  // The last level may be incomplete
+  if (k <= m_size)
+    k = 2 * k + (keys[k] < key);
+
+  return m_ranks[answerNode(k)];
+}
+
+void DateTimeIndex::searchGroup(const long long *keys, size_t count, size_t *result) const {
+  const long long *tree = m_keys;
+  size_t k[SEARCH_GROUP];
+
+  for (size_t i = 0; i < count; i++)
+    k[i] = 1;
+
+  for (int level = 0; level < m_depth; level++) {
+    for (size_t i = 0; i < count; i++) {
+      PREFETCH(tree + (k[i] << PREFETCH_SHIFT));
+      k[i] = 2 * k[i] + (tree[k[i]] < keys[i]);
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (k[i] <= m_size)
+      k[i] = 2 * k[i] + (tree[k[i]] < keys[i]);
+    result[i] = m_ranks[answerNode(k[i])];
+  }
+}
+
+size_t DateTimeIndex::lowerBound(const DateTime &key) const {
+  return search(key.getRaw());
+}
+
+size_t DateTimeIndex::upperBound(const DateTime &key) const {
+  // Keys are integers: the first greater than key is the first not less than key + 1
+  long long raw = key.getRaw();
+  if (raw == LLONG_MAX) return m_size;
+  return search(raw + 1);
+}
+
+DateTimeIndex::Range DateTimeIndex::range(const DateTime &from, const DateTime &to) const {
+  Range result;
+  result.from = search(from.getRaw());
+  result.to = from < to ? search(to.getRaw()) : result.from;
+  return result;
+}
+
+void DateTimeIndex::lowerBounds(const DateTime *keys, size_t count, size_t *result) const {
+  long long raw[SEARCH_GROUP];
+
+  for (size_t start = 0; start < count; start += SEARCH_GROUP) {
+    size_t group = count - start < SEARCH_GROUP ? count - start : SEARCH_GROUP;
+    for (size_t i = 0; i < group; i++)
+      raw[i] = keys[start + i].getRaw();
+    searchGroup(raw, group, result + start);
+  }
+}
+
+void DateTimeIndex::ranges(const DateTime *from, const DateTime *to, size_t count, Range *result) const {
+  const size_t half = SEARCH_GROUP / 2;
+  long long raw[SEARCH_GROUP];
+  size_t found[SEARCH_GROUP];
+
+  for (size_t start = 0; start < count; start += half) {
+    size_t group = count - start < half ? count - start : half;
+    for (size_t i = 0; i < group; i++) {
+      raw[2 * i] = from[start + i].getRaw();
+      raw[2 * i + 1] = to[start + i].getRaw();
+    }
+
+    searchGroup(raw, 2 * group, found);
+
+    for (size_t i = 0; i < group; i++) {
+      result[start + i].from = found[2 * i];
+      result[start + i].to = raw[2 * i] < raw[2 * i + 1] ? found[2 * i + 1] : found[2 * i];
+    }
+  }
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "date.h"
+
+/** Read-only search index over a sorted array of DateTime values
+ *  Keys are kept in Eytzinger (breadth-first) order so the top levels of
+ *  the search tree share few cache lines and the next levels can be
+ *  prefetched. Answers are the same as std::lower_bound/std::upper_bound
+ *  over the source array (up to 4G values).
+ */
+class DateTimeIndex {
+  std::vector<long long> m_storage;   // keys with room to align them to a cache line
+  long long *m_keys;                  // 1-based, Eytzinger order, m_keys[0] starts a cache line
+  std::vector<unsigned int> m_ranks;  // position of m_keys[k] in the source, m_ranks[0] is the size
+  size_t m_size;
+  int m_depth;                        // amount of complete tree levels
+
+  void allocate(size_t count);
+  void place(const DateTime *values, size_t &next, size_t k);
+  size_t search(long long key) const;
+  void searchGroup(const long long *keys, size_t count, size_t *result) const;
+
+public:
+  /** Half-open range of indices in the source array
+   */
+  struct Range {
+    size_t from;
+    size_t to;
+  };
+
+  /** Construct an empty index
+   */
+  DateTimeIndex();
+
+  /** Construct index of a sorted array
+   * /param values      Values sorted by operator <
+   * /param count       Amount of the values
+   */
+  DateTimeIndex(const DateTime *values, size_t count);
+
+  /** Copy constructor. The copy gets its own aligned key array
+   */
+  DateTimeIndex(const DateTimeIndex &other);
+
+  const DateTimeIndex& operator= (const DateTimeIndex &other);
+
+  /** Rebuild index for a sorted array
+   * /param values      Values sorted by operator <
+   * /param count       Amount of the values
+   */
+  void build(const DateTime *values, size_t count);
+
+  /** Get amount of indexed values
+   */
+  size_t size(void) const;
+
+  /** Index of the first value not less than the key
+   * /result      Same as std::lower_bound - values
+   */
+  size_t lowerBound(const DateTime &key) const;
+
+  /** Index of the first value greater than the key
+   * /result      Same as std::upper_bound - values
+   */
+  size_t upperBound(const DateTime &key) const;
+
+  /** Indices of the values in [from, to)
+   */
+  Range range(const DateTime &from, const DateTime &to) const;
+
+  /** Find lower bounds of many keys at once
+   *  Searches are interleaved so their cache misses overlap
+   * /param keys        Keys to look for
+   * /param count       Amount of the keys
+   * /param result      Accepts count indices
+   */
+  void lowerBounds(const DateTime *keys, size_t count, size_t *result) const;
+
+  /** Find indices of many [from, to) intervals at once
+   * /param from        Interval starts
+   * /param to          Interval ends
+   * /param count       Amount of the intervals
+   * /param result      Accepts count ranges
+   */
+  void ranges(const DateTime *from, const DateTime *to, size_t count, Range *result) const;
+};
@@ -0,0 +1,129 @@
+#include "stdafx.h"
+#include "datekey.h"
+#include "dateconst.h"
+#include <climits>
+
+using namespace std;
+
+// Prefixes of the variable encoding:
+//  invalid value
+const unsigned char PREFIX_INVALID = 0x00;
+//  negative values: PREFIX_NEGATIVE minus amount of bytes (longer ones are less)
+const unsigned char PREFIX_NEGATIVE = 0x10;
+//  non-negative values: PREFIX_POSITIVE plus amount of bytes
+const unsigned char PREFIX_POSITIVE = 0x20;
+
+/** Amount of bytes without leading zeros
+ */
+inline size_t significantBytes(unsigned long long value) {
+  size_t result = 0;
+  while (value) {
+    value >>= 8;
+    result++;
+  }
+  return result;
+}
+
+/** Write low count bytes of the value big-endian
+ */
+inline void putBigEndian(unsigned long long value, size_t count, unsigned char *buffer) {
+  for (size_t i = count; i > 0; i--) {
+    buffer[i - 1] = static_cast<unsigned char>(value);
+    value >>= 8;
+  }
+}
+
+inline unsigned long long getBigEndian(const unsigned char *buffer, size_t count) {
+  unsigned long long result = 0;
+  for (size_t i = 0; i < count; i++)
+    result = (result << 8) | buffer[i];
+  return result;
+}
+
+//******************************
+void DateTimeKey::encode(const DateTime &value, unsigned char *buffer) {
+  putBigEndian(toKey(value.getRaw()), FIXED_SIZE, buffer);
+}
+
+DateTime DateTimeKey::decode(const unsigned char *buffer) {
+  DateTime result;
+  result.setRaw(fromKey(getBigEndian(buffer, FIXED_SIZE)));
+  return result;
+}
+
+void DateTimeKey::encode(const DateTime *values, size_t count, unsigned char *buffer) {
+  for (size_t i = 0; i < count; i++)
+    encode(values[i], buffer + i * FIXED_SIZE);
+}
+
+void DateTimeKey::decode(const unsigned char *buffer, size_t count, DateTime *values) {
+  for (size_t i = 0; i < count; i++)
+    values[i] = decode(buffer + i * FIXED_SIZE);
+}
+
+size_t DateTimeKey::encodeVariable(const DateTime &value, unsigned char *buffer) {
+  long long raw = value.getRaw();
+
+  if (raw == LLONG_MIN) {
+    buffer[0] = PREFIX_INVALID;
+    return 1;
+  }
+
+  size_t count;
+  if (raw < 0) {
+    // Low bytes of a negative value are the complement of those of ~raw
+    count = significantBytes(static_cast<unsigned long long>(~raw));
+    buffer[0] = static_cast<unsigned char>(PREFIX_NEGATIVE - count);
+  } else {
+    count = significantBytes(static_cast<unsigned long long>(raw));
+    buffer[0] = static_cast<unsigned char>(PREFIX_POSITIVE + count);
+  }
+
+  putBigEndian(static_cast<unsigned long long>(raw), count, buffer + 1);
+  return count + 1;
+}
+
+size_t DateTimeKey::decodeVariable(const unsigned char *buffer, size_t size, DateTime &value) {
+  if (size == 0) return 0;
+
+  unsigned char prefix = buffer[0];
+  if (prefix == PREFIX_INVALID) {
+    value = DateTime();
+    return 1;
+  }
+
+  size_t count;
+  unsigned long long raw;
+  if (prefix >= PREFIX_NEGATIVE - FIXED_SIZE && prefix <= PREFIX_NEGATIVE) {
+    count = PREFIX_NEGATIVE - prefix;
+    if (size < count + 1) return 0;
+    // Restore the leading 0xFF bytes
+    raw = getBigEndian(buffer + 1, count);
+    if (count < FIXED_SIZE) raw |= ~0ULL << (count * 8);
+  } else if (prefix >= PREFIX_POSITIVE && prefix <= PREFIX_POSITIVE + FIXED_SIZE) {
+    count = prefix - PREFIX_POSITIVE;
+    if (size < count + 1) return 0;
+    raw = getBigEndian(buffer + 1, count);
+  } else
+    return 0;
+
+  value.setRaw(static_cast<long long>(raw));
+  return count + 1;
+}
+
+size_t DateTimeKey::encodeVariable(const DateTime *values, size_t count, unsigned char *buffer) {
+  size_t result = 0;
+  for (size_t i = 0; i < count; i++)
+    result += encodeVariable(values[i], buffer + result);
+  return result;
+}
+
+size_t DateTimeKey::decodeVariable(const unsigned char *buffer, size_t size, size_t count, DateTime *values) {
+  size_t result = 0;
+  for (size_t i = 0; i < count; i++) {
+    size_t used = decodeVariable(buffer + result, size - result, values[i]);
+    if (!used) return 0;
+    result += used;
+  }
+  return result;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include "date.h"
+
+/** Binary DateTime encodings for keys of byte-ordered stores
+ *  Encoded values compare with memcmp() the same way DateTime values
+ *  compare with operator <, the invalid value sorts first.
+ *
+ *  Fixed encoding: 8 bytes, big-endian m_time with the sign bit flipped.
+ *  Variable encoding: a prefix byte giving the class and length, then the
+ *   significant bytes of m_time (1 - 9 bytes, 7 for contemporary dates).
+ *   The prefix defines the length, so encoded values may be followed by
+ *   other key parts.
+ */
+class DateTimeKey {
+public:
+  /** Size of the fixed encoding
+   */
+  static const size_t FIXED_SIZE = 8;
+
+  /** Longest variable encoding
+   */
+  static const size_t MAX_VARIABLE_SIZE = 9;
+
+  /** Encode value in the fixed encoding
+   * /param value       Value to encode
+   * /param buffer      Accepts FIXED_SIZE bytes
+   */
+  static void encode(const DateTime &value, unsigned char *buffer);
+
+  /** Decode value of the fixed encoding
+   * /param buffer      FIXED_SIZE bytes
+   */
+  static DateTime decode(const unsigned char *buffer);
+
+  /** Encode values in the fixed encoding
+   * /param values      Values to encode
+   * /param count       Amount of the values
+   * /param buffer      Accepts count * FIXED_SIZE bytes
+   */
+  static void encode(const DateTime *values, size_t count, unsigned char *buffer);
+
+  /** Decode values of the fixed encoding
+   * /param buffer      count * FIXED_SIZE bytes
+   * /param count       Amount of the values
+   * /param values      Accepts count values
+   */
+  static void decode(const unsigned char *buffer, size_t count, DateTime *values);
+
+  /** Encode value in the variable encoding
+   * /param value       Value to encode
+   * /param buffer      Accepts up to MAX_VARIABLE_SIZE bytes
+   * /result            Amount of bytes written
+   */
+  static size_t encodeVariable(const DateTime &value, unsigned char *buffer);
+
+  /** Decode value of the variable encoding
+   * /param buffer      Encoded bytes
+   * /param size        Amount of bytes available
+   * /param value       Accepts decoded value
+   * /result            Amount of bytes read or zero if the buffer is not a valid encoding
+   */
+  static size_t decodeVariable(const unsigned char *buffer, size_t size, DateTime &value);
+
+  /** Encode values in the variable encoding one after another
+   * /param values      Values to encode
+   * /param count       Amount of the values
+   * /param buffer      Accepts up to count * MAX_VARIABLE_SIZE bytes
+   * /result            Amount of bytes written
+   */
+  static size_t encodeVariable(const DateTime *values, size_t count, unsigned char *buffer);
+
+  /** Decode values of the variable encoding following one another
+   * /param buffer      Encoded bytes
+   * /param size        Amount of bytes available
+   * /param count       Amount of the values
+   * /param values      Accepts count values
+   * /result            Amount of bytes read or zero if the buffer is not a valid encoding
+   */
+  static size_t decodeVariable(const unsigned char *buffer, size_t size, size_t count, DateTime *values);
+};
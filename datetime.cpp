@@ -1,5 +1,6 @@
 // datetime.cpp
 //  Test unit for DateTime class
+//  Also a timestamp column converter: "datetime convert [options] [file...]"
 
 #include "stdafx.h"
 #include <stdio.h>
@@ -8,7 +9,28 @@
 #include <string>
 #include <sstream>
 #include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <climits>
+#include <cstring>
 #include "date.h"
+#include "sniffer.h"
+#include "dateindex.h"
+#include "timeline.h"
+#include "datekey.h"
+#include "datefilter.h"
+#include "timewindow.h"
+#include "renderer.h"
+#include "intervalset.h"
+#include "lazydate.h"
+#ifndef WIN32
+  #include <thread>
+  #include <atomic>
+  #include "convert.h"
+  #include "scheduler.h"
+  #include "windowshard.h"
+#endif
 
 using namespace std;
 
@@ -120,12 +142,839 @@ void testUnixTime(void) {
 }
 
 
+void testFields(void) {
+  cout << endl << "Test fields:" << endl;
+  DateTime time(TEST_DATE);
+  DateTime::Fields f = time.getFields();
+
+  bool result = f.valid
+    && f.year == 2100 && time.getYear() == 2100
+    && f.month == 4 && time.getMonth() == 4
+    && f.day == 1 && time.getDay() == 1
+    && f.hour == 21 && time.getHour() == 21
+    && f.minute == 3 && time.getMinute() == 3
+    && f.second == 15 && time.getSecond() == 15
+    && f.millisecond == 50 && time.getMillisecond() == 50;
+
+  // Out of range fields give an invalid value instead of a shifted one
+  DateTime::Fields bad[] = {
+    {2017, 0, 15, 0, 0, 0, 0, true},
+    {2017, 13, 15, 0, 0, 0, 0, true},
+    {2017, 2, 31, 25, 61, 0, 0, true},
+    {2017, 2, 29, 0, 0, 0, 0, true},
+    {2016, 2, 28, 24, 0, 0, 0, true},
+    {2016, 2, 28, 0, 0, 60, 0, true},
+    {2016, 2, 28, 0, 0, 0, 1000, true},
+    {2016, 2, 28, 0, -1, 0, 0, true},
+    {0, 1, 1, 0, 0, 0, 0, true}
+  };
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    DateTime value(TEST_DATE);
+    value.set(bad[i]);
+    result &= !value.isValid();
+  }
+  DateTime::Fields leapDay = {2016, 2, 29, 23, 59, 59, 999, true};
+  time.set(leapDay);
+  result &= time.isValid() && time.getFields().day == 29 && time.getMillisecond() == 999;
+
+  if (result) {
+    cout << "Fields match!" << endl;
+  } else {
+    cout << "Fields mismatch: " << f.year << '-' << f.month << '-' << f.day
+      << ' ' << f.hour << ':' << f.minute << ':' << f.second << '.' << f.millisecond << endl;
+  }
+}
+
+
+void testSniffer(void) {
+  cout << endl << "Test layout sniffing:" << endl;
+  const char *samples[][2] = {
+    {"2017-01-17",              "2017-01-17"},
+    {"2017-01-17 17:19:21",     "2017-01-17 17:19:21"},
+    {"2017-01-17 17:19:21.012", "2017-01-17 17:19:21.012"},
+    {"2017-01-17T17:19:21",     "2017-01-17 17:19:21"},
+    {"2017-01-17T17:19:21.012", "2017-01-17 17:19:21.012"},
+    {"17.01.2017",              "2017-01-17"},
+    {"17.01.2017 17:19:21",     "2017-01-17 17:19:21"}
+  };
+
+  bool result = true;
+  for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+    string value(samples[i][0]);
+
+    DateTimeSniffer sniffer(1);
+    sniffer.sample(value);
+    DateTime time = sniffer.getParser().parse(value);
+
+    if (sniffer.getLayout() == DateTimeParser::LAYOUT_GENERIC
+      || time != DateTime(string(samples[i][1]))) {
+      cout << value << " parsed as " << time.formatDateTime() << endl;
+      result = false;
+    }
+  }
+
+  // Values which don't fit the layout go through the generic parser
+  DateTimeParser parser(DateTimeParser::LAYOUT_DATE);
+  if (parser.parse(TEST_DATE) != DateTime(TEST_DATE)) {
+    cout << "Fallback mismatch for " << TEST_DATE << endl;
+    result = false;
+  }
+
+  // Day-first and out of range values are invalid instead of generic
+  const char *invalid[] = {"30.02.2017", "7.01.2017", "17.1.2017 10:00", "2017-02-29", "2017-01-17 24:00:00",
+    "0000-01-01", "01.01.0000 10:00:00"};
+  DateTimeParser dmyParser(DateTimeParser::LAYOUT_DMY);
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+    if (dmyParser.parse(invalid[i]).isValid() || parser.parse(invalid[i]).isValid()) {
+      cout << invalid[i] << " parsed as " << dmyParser.parse(invalid[i]).formatDateTime() << endl;
+      result = false;
+    }
+  }
+  // Other fixed layouts still work for DMY parsers, SQL-like text still goes generic
+  if (dmyParser.parse(TEST_DATE) != DateTime(TEST_DATE)
+    || parser.parse("2017-01-17 10:00") != DateTime(string("2017-01-17 10:00"))) {
+    cout << "Fallback mismatch for DMY parser" << endl;
+    result = false;
+  }
+
+  // Years are always 4 digits, the ones which don't fit give no text
+  char text[DateTimeParser::MAX_LENGTH];
+  DateTime early(string("0099-01-02 03:04:05"));
+  DateTime late(string("9999-12-31 00:00:00"));
+  late.incYear(1);
+  DateTime beforeYear1;
+  beforeYear1.setRaw(-86400000LL);
+  if (string(text, parser.format(early, text)) != "0099-01-02"
+    || DateTimeParser().format(late, text) != 0 || DateTimeParser().format(beforeYear1, text) != 0) {
+    cout << "Year formatting mismatch" << endl;
+    result = false;
+  }
+
+  // February 29 fits the layout only in leap years
+  DateTime leapDay;
+  if (!parser.parseFast("2016-02-29", 10, leapDay) || parser.parseFast("2017-02-29", 10, leapDay)
+    || parser.parseFast("1900-02-29", 10, leapDay) || !parser.parseFast("2000-02-29", 10, leapDay)) {
+    cout << "Leap day check mismatch" << endl;
+    result = false;
+  }
+
+  if (result) cout << "All layouts match!" << endl;
+}
+
+
+void testIndex(void) {
+  cout << endl << "Test search index:" << endl;
+
+  // Sorted timeline with duplicates
+  vector<DateTime> timeline;
+  DateTime t(TEST_DATE);
+  srand(1);
+  for (int i = 0; i < 10000; i++) {
+    timeline.push_back(t);
+    t.incSecond(rand() % 3);
+  }
+
+  bool result = true;
+  for (size_t count = 0; count <= timeline.size() && result; count = count * 2 + 1) {
+    DateTimeIndex index(timeline.empty() ? nullptr : &timeline[0], count);
+
+    vector<DateTime> keys;
+    DateTime key(TEST_DATE);
+    key.incSecond(-2);
+    for (int i = 0; i < 250; i++) {
+      keys.push_back(key);
+      key.incSecond(rand() % 200);
+    }
+
+    vector<size_t> bounds(keys.size());
+    index.lowerBounds(&keys[0], keys.size(), &bounds[0]);
+
+    // Copies own their keys and keep answering after the source is rebuilt
+    DateTimeIndex copy(index), assigned;
+    assigned = copy;
+    copy.build(&timeline[0], 0);
+
+    for (size_t i = 0; i < keys.size(); i++) {
+      vector<DateTime>::iterator end = timeline.begin() + count;
+      size_t lower = lower_bound(timeline.begin(), end, keys[i]) - timeline.begin();
+      size_t upper = upper_bound(timeline.begin(), end, keys[i]) - timeline.begin();
+      if (index.lowerBound(keys[i]) != lower || bounds[i] != lower || index.upperBound(keys[i]) != upper
+        || assigned.lowerBound(keys[i]) != lower) {
+        cout << "Bounds mismatch for " << keys[i].formatDateTime() << " in " << count << " values" << endl;
+        result = false;
+        break;
+      }
+    }
+
+    // Intervals of permuted keys: some are reversed (empty), one starts at an invalid time
+    vector<DateTime> from(keys), to(keys.size());
+    for (size_t i = 0; i < keys.size(); i++)
+      to[i] = keys[i * 97 % keys.size()];
+    from[0] = DateTime();
+    vector<DateTimeIndex::Range> found(keys.size());
+    index.ranges(&from[0], &to[0], keys.size(), &found[0]);
+
+    for (size_t i = 0; i < keys.size() && result; i++) {
+      vector<DateTime>::iterator end = timeline.begin() + count;
+      size_t low = lower_bound(timeline.begin(), end, from[i]) - timeline.begin();
+      size_t high = from[i] < to[i] ? lower_bound(timeline.begin(), end, to[i]) - timeline.begin() : low;
+      DateTimeIndex::Range single = index.range(from[i], to[i]);
+      if (single.from != low || single.to != high || found[i].from != low || found[i].to != high) {
+        cout << "Range mismatch for " << from[i].formatDateTime() << " - " << to[i].formatDateTime()
+          << " in " << count << " values" << endl;
+        result = false;
+      }
+    }
+  }
+
+  if (result) cout << "Bounds match!" << endl;
+}
+
+
+void testTimeline(void) {
+  cout << endl << "Test compressed timeline:" << endl;
+
+  // Nearly sorted values with an invalid one in the middle
+  vector<DateTime> values;
+  DateTime t(TEST_DATE);
+  srand(2);
+  for (int i = 0; i < 1000; i++) {
+    DateTime value(t);
+    value.incSecond(rand() % 5 - 2);
+    values.push_back(i == 500 ? DateTime() : value);
+    t.incMinute(1);
+  }
+
+  CompressedTimeline timeline(&values[0], values.size());
+
+  // Round trip through a stream and an attached copy of the image
+  stringstream stream;
+  timeline.write(stream);
+  CompressedTimeline loaded;
+  bool result = loaded.read(stream);
+
+  vector<unsigned long long> image(timeline.getDataSize() / sizeof(unsigned long long));
+  memcpy(&image[0], timeline.getData(), timeline.getDataSize());
+  CompressedTimeline attached;
+  result &= attached.attach(&image[0], timeline.getDataSize());
+
+  for (size_t i = 0; i < values.size() && result; i++) {
+    if (loaded.at(i) != values[i] || attached.at(i) != values[i]) {
+      cout << "Value mismatch at " << i << endl;
+      result = false;
+    }
+  }
+
+  DateTime from(values[100]);
+  DateTime to(values[300]);
+  vector<DateTime> selected;
+  attached.select(from, to, selected);
+  size_t expected = 0;
+  for (size_t i = 0; i < values.size(); i++)
+    if (values[i] >= from && values[i] < to) expected++;
+  result &= selected.size() == expected;
+
+  // Every kernel on narrow, zero-width (regular cadence) and full-width blocks
+  vector<DateTime> regular, wide;
+  DateTime r(TEST_DATE);
+  for (int i = 0; i < 1000; i++) {
+    regular.push_back(r);
+    r.incSecond(30);
+    DateTime w;
+    w.setRaw(static_cast<long long>((static_cast<unsigned long long>(rand()) << 40) ^ (static_cast<unsigned long long>(rand()) << 20) ^ rand()));
+    wide.push_back(w);
+  }
+  const vector<DateTime> *sources[] = {&values, &regular, &wide};
+  CompressedTimeline::Kernel best = CompressedTimeline::getKernel();
+  const char *names[] = {"scalar", "AVX2"};
+  for (int kernel = CompressedTimeline::KERNEL_SCALAR; kernel <= CompressedTimeline::KERNEL_AVX2; kernel++) {
+    if (!CompressedTimeline::setKernel(static_cast<CompressedTimeline::Kernel>(kernel))) continue;
+
+    bool match = true;
+    for (size_t source = 0; source < 3; source++) {
+      const vector<DateTime> &expected = *sources[source];
+      CompressedTimeline encoded(&expected[0], expected.size());
+      DateTime decoded[CompressedTimeline::BLOCK_SIZE];
+      for (size_t block = 0; block < encoded.blockCount(); block++) {
+        size_t count = encoded.decodeBlock(block, decoded);
+        for (size_t i = 0; i < count; i++)
+          match &= decoded[i] == expected[block * CompressedTimeline::BLOCK_SIZE + i];
+      }
+    }
+    cout << names[kernel] << (match ? " kernels match" : " kernels mismatch!") << endl;
+    result &= match;
+  }
+  CompressedTimeline::setKernel(best);
+
+  // Corrupt header claiming a huge image
+  image[3] = 1ULL << 60;
+  stringstream corrupt;
+  corrupt.write(reinterpret_cast<const char*>(&image[0]), timeline.getDataSize());
+  result &= !loaded.read(corrupt) && loaded.size() == 0;
+
+  if (result)
+    cout << "Timeline matches: " << timeline.getDataSize() << " bytes for " << values.size() << " values" << endl;
+  else
+    cout << "Timeline mismatch!" << endl;
+}
+
+
+void testKeys(void) {
+  cout << endl << "Test binary keys:" << endl;
+
+  // Invalid, negative, around zero and ordinary values
+  vector<DateTime> values(1);
+  long long samples[] = {LLONG_MIN + 1, -1000000000000LL, -256, -1, 0, 1, 255, 256};
+  for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+    DateTime value;
+    value.setRaw(samples[i]);
+    values.push_back(value);
+  }
+  DateTime t(SECOND_DATE);
+  srand(4);
+  for (int i = 0; i < 200; i++) {
+    values.push_back(t);
+    t.incSecond(rand() % 100000 + 1);
+  }
+  values.push_back(DateTime());
+  values.back().setRaw(LLONG_MAX);
+
+  vector<unsigned char> fixed(values.size() * DateTimeKey::FIXED_SIZE);
+  vector<unsigned char> variable(values.size() * DateTimeKey::MAX_VARIABLE_SIZE);
+  DateTimeKey::encode(&values[0], values.size(), &fixed[0]);
+  size_t size = DateTimeKey::encodeVariable(&values[0], values.size(), &variable[0]);
+
+  vector<DateTime> decoded(values.size());
+  DateTimeKey::decode(&fixed[0], values.size(), &decoded[0]);
+  bool result = decoded == values;
+  result &= DateTimeKey::decodeVariable(&variable[0], size, values.size(), &decoded[0]) == size;
+  result &= decoded == values;
+
+  // Byte order must follow operator <
+  unsigned char previous[DateTimeKey::MAX_VARIABLE_SIZE];
+  size_t previousSize = 0;
+  for (size_t i = 0; i < values.size() && result; i++) {
+    unsigned char key[DateTimeKey::MAX_VARIABLE_SIZE];
+    size_t keySize = DateTimeKey::encodeVariable(values[i], key);
+    if (i > 0) {
+      int order = memcmp(previous, key, min(previousSize, keySize));
+      result &= order < 0 || (order == 0 && previousSize < keySize);
+      result &= memcmp(&fixed[(i - 1) * DateTimeKey::FIXED_SIZE], &fixed[i * DateTimeKey::FIXED_SIZE], DateTimeKey::FIXED_SIZE) < 0;
+    }
+    memcpy(previous, key, keySize);
+    previousSize = keySize;
+  }
+
+  if (result)
+    cout << "Keys keep the order: " << size << " variable bytes for " << values.size() << " values" << endl;
+  else
+    cout << "Key order mismatch!" << endl;
+}
+
+
+void testFilter(void) {
+  cout << endl << "Test range filters:" << endl;
+
+  // Unsorted values with invalid ones
+  vector<DateTime> values;
+  srand(5);
+  for (int i = 0; i < 1003; i++) {
+    DateTime value(TEST_DATE);
+    value.incMinute(rand() % 10000);
+    values.push_back(i % 17 == 0 ? DateTime() : value);
+  }
+
+  DateTime from(TEST_DATE);
+  from.incMinute(2000);
+  DateTime to(TEST_DATE);
+  to.incMinute(5000);
+
+  size_t expected = 0;
+  size_t valid = 0;
+  DateTime least, greatest;
+  for (size_t i = 0; i < values.size(); i++) {
+    if (values[i] >= from && values[i] < to) expected++;
+    if (!values[i].isValid()) continue;
+    valid++;
+    if (!least.isValid() || values[i] < least) least = values[i];
+    if (values[i] > greatest) greatest = values[i];
+  }
+
+  DateTimeFilter::Kernel best = DateTimeFilter::getKernel();
+  const char *names[] = {"scalar", "AVX2", "AVX-512"};
+  bool result = true;
+
+  for (int kernel = DateTimeFilter::KERNEL_SCALAR; kernel <= DateTimeFilter::KERNEL_AVX512; kernel++) {
+    if (!DateTimeFilter::setKernel(static_cast<DateTimeFilter::Kernel>(kernel))) continue;
+
+    vector<unsigned long long> bitmap((values.size() + 63) / 64);
+    vector<size_t> indices(values.size());
+    DateTime low, high;
+
+    bool match = DateTimeFilter::count(&values[0], values.size(), from, to) == expected
+      && DateTimeFilter::select(&values[0], values.size(), from, to, &bitmap[0]) == expected
+      && DateTimeFilter::selectIndices(&values[0], values.size(), from, to, &indices[0]) == expected
+      && DateTimeFilter::minMax(&values[0], values.size(), low, high) == valid
+      && low == least && high == greatest
+      && DateTimeFilter::count(&values[0], values.size(), DateTime(), to) == DateTimeFilter::count(&values[0], values.size(), least, to);
+
+    for (size_t i = 0; i < expected && match; i++) {
+      size_t index = indices[i];
+      match = values[index] >= from && values[index] < to
+        && (bitmap[index / 64] >> (index % 64)) & 1;
+    }
+
+    cout << names[kernel] << (match ? " kernels match" : " kernels mismatch!") << endl;
+    result &= match;
+  }
+
+  DateTimeFilter::setKernel(best);
+}
+
+
+void testWindow(void) {
+  cout << endl << "Test sliding window:" << endl;
+
+  // A minute of one-second buckets, events split between two "threads"
+  TimeWindow window(1000, 60);
+  TimeWindow odd(1000, 60);
+  TimeWindow even(1000, 60);
+  vector<DateTime> events;
+
+  DateTime t(TEST_DATE);
+  srand(6);
+  bool result = true;
+  for (int i = 0; i < 5000 && result; i++) {
+    t.incSecond(rand() % 3);
+    events.push_back(t);
+    window.add(t, i);
+    (i % 2 ? odd : even).add(t, i);
+
+    // Events within the last 60 whole seconds
+    long long count = 0;
+    long long sum = 0;
+    DateTime start(window.getEnd());
+    start.incSecond(-59);
+    for (size_t j = 0; j < events.size(); j++) {
+      if (events[j] >= start) {
+        count++;
+        sum += j;
+      }
+    }
+    result = window.getCount() == count && window.getSum() == sum;
+  }
+
+  TimeWindow merged(1000, 60);
+  merged.merge(odd);
+  merged.merge(even);
+  result &= merged.getCount() == window.getCount() && merged.getSum() == window.getSum();
+
+  t.incMinute(2);
+  window.advance(t);
+  result &= window.getCount() == 0;
+
+  if (result)
+    cout << "Window totals match!" << endl;
+  else
+    cout << "Window totals mismatch!" << endl;
+}
+
+
+void testRenderer(void) {
+  cout << endl << "Test timestamp renderer:" << endl;
+
+  TimestampRenderer renderer;
+  DateTimeParser layout(DateTimeParser::LAYOUT_DATETIME_MS);
+  char expected[DateTimeParser::MAX_LENGTH + 1];
+
+  // Small steps crossing seconds, minutes, hours and days, some going back
+  DateTime t("2016-12-31 22:59:58.990");
+  srand(7);
+  bool result = true;
+  for (int i = 0; i < 100000 && result; i++) {
+    if (i % 1000 == 999)
+      t.incSecond(-rand() % 100);
+    else
+      t.incSecond(rand() % 3 ? 0 : 1).incMinute(rand() % 50 ? 0 : 7);
+    if (rand() % 2) t.setRaw(t.getRaw() + rand() % 20);
+
+    expected[layout.format(t, expected)] = 0;
+    const char *stamp = renderer.render(t);
+    if (strcmp(stamp, expected) != 0) {
+      cout << stamp << " != " << expected << endl;
+      result = false;
+    }
+  }
+
+  // The last renderable millisecond, then year 10000 and a time before the year 1
+  DateTime last("9999-12-31 23:59:59.999");
+  result &= strcmp(renderer.render(last), "9999-12-31 23:59:59.999") == 0;
+  last.incSecond(2);
+  result &= strcmp(renderer.render(last), "") == 0;
+  DateTime early;
+  early.setRaw(-1500);
+  result &= strcmp(renderer.render(early), "") == 0;
+  result &= strcmp(renderer.render(DateTime("2017-01-17 10:00:00.000")), "2017-01-17 10:00:00.000") == 0;
+
+  if (result) cout << "Stamps match!" << endl;
+}
+
+
+void makeIntervals(int count, vector<DateTime> &from, vector<DateTime> &to) {
+  // Intervals of a few hours within a month, overlapping and touching
+  from.clear();
+  to.clear();
+  for (int i = 0; i < count; i++) {
+    DateTime start(TEST_DATE);
+    start.incHour(rand() % 720);
+    DateTime end(start);
+    end.incHour(rand() % 12);
+    from.push_back(start);
+    to.push_back(end);
+  }
+}
+
+bool inIntervals(const vector<DateTime> &from, const vector<DateTime> &to, const DateTime &time) {
+  for (size_t i = 0; i < from.size(); i++)
+    if (time >= from[i] && time < to[i]) return true;
+  return false;
+}
+
+void testIntervals(void) {
+  cout << endl << "Test interval sets:" << endl;
+
+  vector<DateTime> from1, to1, from2, to2;
+  srand(8);
+  makeIntervals(60, from1, to1);
+  makeIntervals(60, from2, to2);
+
+  IntervalSet set1(&from1[0], &to1[0], from1.size());
+  IntervalSet set2(&from2[0], &to2[0], from2.size());
+  IntervalSet united = IntervalSet::unite(set1, set2);
+  IntervalSet common = IntervalSet::intersect(set1, set2);
+  IntervalSet difference = IntervalSet::subtract(set1, set2);
+
+  // Check every half hour of the month
+  bool result = true;
+  long long hours = 0;
+  DateTime t(TEST_DATE);
+  t.incHour(-1);
+  for (int i = 0; i < 1600 && result; i++) {
+    bool in1 = inIntervals(from1, to1, t);
+    bool in2 = inIntervals(from2, to2, t);
+    DateTime next(t);
+    next.incMinute(30);
+    hours += in1 || in2;
+
+    result = set1.contains(t) == in1
+      && united.contains(t) == (in1 || in2)
+      && common.contains(t) == (in1 && in2)
+      && difference.contains(t) == (in1 && !in2)
+      && (!in1 || set1.overlaps(t, next));
+    t = next;
+  }
+
+  // Hour-aligned intervals: every other half hour sample is an hour
+  result &= united.getDuration() == hours / 2 * 3600000
+    && united.getDays() == static_cast<int>(hours / 2 / 24)
+    && IntervalSet::unite(difference, common) == set1;
+
+  set1.add(from2[0], to2[0]);
+  result &= set1.contains(from2[0]);
+
+  if (result)
+    cout << "Interval sets match: " << united.size() << " intervals, " << united.getDays() << " days" << endl;
+  else
+    cout << "Interval sets mismatch!" << endl;
+}
+
+
+void testLazy(void) {
+  cout << endl << "Test lazy values:" << endl;
+
+  const char *texts[] = {"2015-03-01 10:20:30", "01.03.2015 10:20:30", "2015-03-01T10:20:30.000", "2015-03-01 10:20:31"};
+  TextArena arena(64);
+  vector<LazyDateTime> values;
+  for (int i = 0; i < 4; i++) {
+    const char *text = arena.store(texts[i], strlen(texts[i]));
+    values.push_back(LazyDateTime(text, strlen(texts[i]), DateTimeParser::LAYOUT_DATETIME));
+  }
+
+  // Pass-through: same bytes out, nothing parsed
+  string line;
+  for (int i = 0; i < 4; i++) {
+    if (i) line += ';';
+    values[i].appendTo(line);
+  }
+  bool result = line == "2015-03-01 10:20:30;01.03.2015 10:20:30;2015-03-01T10:20:30.000;2015-03-01 10:20:31"
+    && !values[0].isParsed() && !values[3].isParsed();
+
+  // Comparison parses on demand, whatever layout the text has
+  result &= values[0] == values[1] && values[1] == values[2] && values[2] < values[3]
+    && values[0].isParsed() && values[3].getFields().second == 31;
+
+  // Modified values are written in the layout of their source
+  values[1].incDay(1);
+  values[2].incSecond(1);
+  char buffer[DateTimeParser::MAX_LENGTH];
+  result &= string(buffer, values[1].write(buffer)) == "02.03.2015 10:20:30"
+    && string(buffer, values[2].write(buffer)) == "2015-03-01T10:20:31.000"
+    && values[2] == values[3] && values[1].getLength() == 19 && !values[0].isModified();
+
+  LazyDateTime invalid("not a date", 10);
+  invalid.incDay(1);
+  string text;
+  invalid.appendTo(text);
+  result &= !invalid.isValid() && !invalid.isModified() && invalid.getLength() == 10 && text == "not a date"
+    && LazyDateTime(DateTime("2015-03-01 10:20:31")) == values[3];
+
+  if (result)
+    cout << "Lazy values match: " << line << endl;
+  else
+    cout << "Lazy values mismatch!" << endl;
+}
+
+
+#ifndef WIN32
+string convertText(const ConvertOptions &options, const string &text) {
+  FILE *input = tmpfile();
+  FILE *output = tmpfile();
+  string result;
+  if (input && output) {
+    fwrite(text.data(), 1, text.size(), input);
+    rewind(input);
+    if (convertStream(options, input, output)) {
+      rewind(output);
+      char buffer[4096];
+      size_t count;
+      while ((count = fread(buffer, 1, sizeof(buffer), output)) > 0)
+        result.append(buffer, count);
+    } else
+      result = "<error>";
+  }
+  if (input) fclose(input);
+  if (output) fclose(output);
+  return result;
+}
+
+void testConverter(void) {
+  cout << endl << "Test converter:" << endl;
+
+  // Header, CRLF every third line, bad cells, no newline at the end
+  string input = "id;time;note\n";
+  string expected = input;
+  DateTime t(TEST_DATE);
+  DateTimeParser parser(DateTimeParser::LAYOUT_DATETIME);
+  char buffer[DateTimeParser::MAX_LENGTH];
+  for (int i = 0; i < 500; i++) {
+    t.incSecond(37);
+    string cell(buffer, parser.format(t, buffer));
+    DateTime shifted(t);
+    shifted.incMinute(90);
+    string converted(buffer, parser.format(shifted, buffer));
+    if (i % 50 == 7) cell = converted = "n/a";
+
+    const char *eol = i == 499 ? "" : (i % 3 ? "\n" : "\r\n");
+    ostringstream line;
+    line << i << ';';
+    input += line.str() + cell + ";x" + eol;
+    expected += line.str() + converted + ";x" + eol;
+  }
+
+  ConvertOptions options;
+  options.delimiter = ';';
+  options.columns[0] = 1;
+  options.shiftMinutes = 90;
+  options.header = true;
+
+  // Tiny chunks split lines everywhere, the carried tails have to keep the order
+  bool result = true;
+  size_t chunkSizes[] = {1, 7, 64, 4096};
+  int threads[] = {1, 2, 8};
+  for (size_t i = 0; i < sizeof(chunkSizes) / sizeof(chunkSizes[0]); i++) {
+    for (size_t j = 0; j < sizeof(threads) / sizeof(threads[0]); j++) {
+      options.chunkSize = chunkSizes[i];
+      options.threads = threads[j];
+      if (convertText(options, input) != expected) {
+        cout << "Mismatch for " << chunkSizes[i] << "-byte chunks and " << threads[j] << " threads" << endl;
+        result = false;
+      }
+    }
+  }
+
+  // Without -H the header is a line with a bad cell
+  options.header = false;
+  result &= convertText(options, input) == expected;
+
+  // Mixed layouts in a column: every cell keeps its own precision
+  ConvertOptions mixed;
+  mixed.shiftMinutes = 30;
+  result &= convertText(mixed,
+      "2017-01-17\n2017-01-18 11:00:00.250\n2017-01-19 12:00:00\n20.01.2017 10:00:00\n2017-01-21T10:00:00\n")
+    == "2017-01-17\n2017-01-18 11:30:00.250\n2017-01-19 12:30:00\n20.01.2017 10:30:00\n2017-01-21T10:30:00\n";
+  mixed.shiftMinutes = 0;
+  string precise = "2017-01-17 10:00:00\n2017-01-18 11:00:00\n2017-01-19 12:00:00.123\n";
+  result &= convertText(mixed, precise) == precise;
+
+  if (result)
+    cout << "Converted text matches: " << input.size() << " bytes" << endl;
+}
+
+
+void testWindowShards(void) {
+  cout << endl << "Test window shards:" << endl;
+
+  // Producers own a shard each, the collector merges while they run
+  const int THREADS = 4;
+  const int EVENTS = 200000;
+  vector<DateTime> events;
+  long long raw = DateTime(TEST_DATE).getRaw();
+  srand(9);
+  for (int i = 0; i < EVENTS; i++) {
+    raw += rand() % 5;
+    DateTime t;
+    t.setRaw(raw);
+    events.push_back(t);
+  }
+
+  vector<TimeWindowShard*> shards;
+  for (int i = 0; i < THREADS; i++)
+    shards.push_back(new TimeWindowShard(100, 50));
+
+  atomic<int> running(THREADS);
+  vector<thread> producers;
+  for (int i = 0; i < THREADS; i++) {
+    producers.push_back(thread([&, i]() {
+      for (int j = i; j < EVENTS; j += THREADS)
+        shards[i]->add(events[j], 2);
+      running--;
+    }));
+  }
+
+  bool result = true;
+  int snapshots = 0;
+  do {
+    TimeWindow total(100, 50);
+    for (int i = 0; i < THREADS; i++)
+      result &= shards[i]->mergeInto(total);
+    result &= total.getCount() >= 0 && total.getCount() <= EVENTS && total.getSum() >= 0;
+    snapshots++;
+  } while (running > 0);
+
+  for (size_t i = 0; i < producers.size(); i++)
+    producers[i].join();
+
+  // Once the producers stop, the merge equals a single window over all events
+  TimeWindow expected(100, 50);
+  for (int i = 0; i < EVENTS; i++)
+    expected.add(events[i], 2);
+  TimeWindow total(100, 50);
+  for (int i = 0; i < THREADS; i++)
+    shards[i]->mergeInto(total);
+  result &= total.getCount() == expected.getCount() && total.getSum() == expected.getSum()
+    && total.getEnd() == expected.getEnd();
+
+  for (int i = 0; i < THREADS; i++)
+    delete shards[i];
+
+  if (result)
+    cout << "Shard totals match after " << snapshots << " concurrent merges" << endl;
+  else
+    cout << "Shard totals mismatch!" << endl;
+}
+
+
+void testScheduler(void) {
+  cout << endl << "Test scheduler:" << endl;
+
+  DateTime now(TEST_DATE);
+  DateTimeScheduler scheduler(now);
+
+  // Deadlines from milliseconds to years ahead, every third job cancelled
+  vector<DateTime> deadlines;
+  vector<DateTimeScheduler::Handle> handles;
+  srand(3);
+  for (int i = 0; i < 3000; i++) {
+    DateTime deadline(now);
+    switch (i % 4) {
+      case 0: deadline.incSecond(rand() % 100); break;
+      case 1: deadline.incHour(rand() % 1000); break;
+      case 2: deadline.incDay(rand() % 1000); break;
+      default: deadline.incMonth(rand() % 100); break;
+    }
+    deadlines.push_back(deadline);
+    handles.push_back(scheduler.schedule(deadline, i));
+  }
+  for (size_t i = 0; i < handles.size(); i += 3)
+    scheduler.cancel(handles[i]);
+  scheduler.rescheduleMonths(handles[1], 1);
+  deadlines[1].incMonth(1);
+  scheduler.post(now, 3000);
+  deadlines.push_back(now);
+
+  bool result = true;
+  vector<DateTimeScheduler::Job> jobs;
+  DateTime last;
+  for (int step = 0; step < 200 && result; step++) {
+    now.incDay(20);
+    jobs.clear();
+    scheduler.expire(now, jobs);
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+      const DateTimeScheduler::Job &job = jobs[i];
+      if ((job.payload % 3 == 0 && job.payload != 3000)
+        || job.deadline != deadlines[job.payload]
+        || job.deadline > now
+        || job.deadline < last) {
+        cout << "Unexpected job " << job.payload << " at " << job.deadline.formatDateTime() << endl;
+        result = false;
+        break;
+      }
+      last = job.deadline;
+    }
+  }
+
+  // Overdue jobs come out even when the new time is earlier than the current one
+  scheduler.schedule(DateTime(TEST_DATE), 3001);
+  jobs.clear();
+  DateTime earlier(TEST_DATE);
+  earlier.incDay(-1);
+  result &= scheduler.expire(earlier, jobs) == 1 && jobs[0].payload == 3001;
+
+  if (result && scheduler.size() == 0)
+    cout << "All jobs expired in order!" << endl;
+  else if (result)
+    cout << scheduler.size() << " jobs left" << endl;
+}
+#endif
+
+
 int _tmain(int argc, _TCHAR* argv[])
 {
+#ifndef WIN32
+  if (argc > 1 && string(argv[1]) == "convert")
+    return runConverter(argc - 2, argv + 2);
+#endif
+
   testTimezone();
   testSingle();
   testUnixTime();
   testDifference();
+  testFields();
+  testSniffer();
+  testIndex();
+  testTimeline();
+  testKeys();
+  testFilter();
+  testWindow();
+  testRenderer();
+  testIntervals();
+  testLazy();
+#ifndef WIN32
+  testConverter();
+  testWindowShards();
+  testScheduler();
+#endif
   testMonts();
   testDays();
 
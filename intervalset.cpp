@@ -0,0 +1,147 @@
+#include "stdafx.h"
+#include "intervalset.h"
+#include "dateconst.h"
+#include <algorithm>
+#include <climits>
+#include <utility>
+
+using namespace std;
+
+// Operations of combine()
+const int OPERATION_UNION = 0;
+const int OPERATION_INTERSECTION = 1;
+const int OPERATION_DIFFERENCE = 2;
+
+inline bool applyOperation(int operation, bool inFirst, bool inSecond) {
+  switch (operation) {
+    case OPERATION_UNION: return inFirst || inSecond;
+    case OPERATION_INTERSECTION: return inFirst && inSecond;
+    default: return inFirst && !inSecond;
+  }
+}
+
+IntervalSet::IntervalSet() {}
+
+IntervalSet::IntervalSet(const DateTime *from, const DateTime *to, size_t count) {
+  assign(from, to, count);
+}
+
+void IntervalSet::assign(const DateTime *from, const DateTime *to, size_t count) {
+  vector<pair<long long, long long> > intervals;
+  intervals.reserve(count);
+  for (size_t i = 0; i < count; i++)
+    if (from[i].isValid() && from[i] < to[i])
+      intervals.push_back(make_pair(from[i].getRaw(), to[i].getRaw()));
+
+  sort(intervals.begin(), intervals.end());
+
+  // Sweep: extend the last interval while the next one starts within or right at its end
+  m_bounds.clear();
+  m_bounds.reserve(intervals.size() * 2);
+  for (size_t i = 0; i < intervals.size(); i++) {
+    if (!m_bounds.empty() && intervals[i].first <= m_bounds.back()) {
+      if (intervals[i].second > m_bounds.back())
+        m_bounds.back() = intervals[i].second;
+    } else {
+      m_bounds.push_back(intervals[i].first);
+      m_bounds.push_back(intervals[i].second);
+    }
+  }
+}
+
+void IntervalSet::add(const DateTime &from, const DateTime &to) {
+  *this = unite(*this, IntervalSet(&from, &to, 1));
+}
+
+size_t IntervalSet::size(void) const {
+  return m_bounds.size() / 2;
+}
+
+bool IntervalSet::empty(void) const {
+  return m_bounds.empty();
+}
+
+DateTime IntervalSet::getFrom(size_t index) const {
+  DateTime result;
+  if (index < size()) result.setRaw(m_bounds[2 * index]);
+  return result;
+}
+
+DateTime IntervalSet::getTo(size_t index) const {
+  DateTime result;
+  if (index < size()) result.setRaw(m_bounds[2 * index + 1]);
+  return result;
+}
+
+bool IntervalSet::contains(const DateTime &time) const {
+  if (!time.isValid()) return false;
+
+  // Passing an odd amount of bounds means being inside an interval
+  size_t passed = upper_bound(m_bounds.begin(), m_bounds.end(), time.getRaw()) - m_bounds.begin();
+  return passed % 2 == 1;
+}
+
+bool IntervalSet::overlaps(const DateTime &from, const DateTime &to) const {
+  if (!from.isValid() || !(from < to)) return false;
+
+  size_t passed = upper_bound(m_bounds.begin(), m_bounds.end(), from.getRaw()) - m_bounds.begin();
+  if (passed % 2 == 1) return true;
+
+  // Otherwise the next interval has to start before the end
+  return passed < m_bounds.size() && m_bounds[passed] < to.getRaw();
+}
+
+long long IntervalSet::getDuration(void) const {
+  long long result = 0;
+  for (size_t i = 0; i < m_bounds.size(); i += 2)
+    result += m_bounds[i + 1] - m_bounds[i];
+  return result;
+}
+
+int IntervalSet::getDays(void) const {
+  return static_cast<int>(getDuration() / MILLISECS_IN_DAY);
+}
+
+IntervalSet IntervalSet::combine(const IntervalSet &set1, const IntervalSet &set2, int operation) {
+  const vector<long long> &bounds1 = set1.m_bounds;
+  const vector<long long> &bounds2 = set2.m_bounds;
+  size_t i = 0;
+  size_t j = 0;
+  bool inside = false;
+
+  IntervalSet result;
+  result.m_bounds.reserve(bounds1.size() + bounds2.size());
+
+  // Walk all bounds in order; after passing an even-indexed bound we are inside
+  //  that set. Equal bounds are passed together, so touching results merge
+  while (i < bounds1.size() || j < bounds2.size()) {
+    long long point;
+    if (j >= bounds2.size() || (i < bounds1.size() && bounds1[i] <= bounds2[j]))
+      point = bounds1[i];
+    else
+      point = bounds2[j];
+
+    while (i < bounds1.size() && bounds1[i] == point) i++;
+    while (j < bounds2.size() && bounds2[j] == point) j++;
+
+    bool now = applyOperation(operation, i % 2 == 1, j % 2 == 1);
+    if (now != inside) {
+      result.m_bounds.push_back(point);
+      inside = now;
+    }
+  }
+
+  return result;
+}
+
+IntervalSet IntervalSet::unite(const IntervalSet &set1, const IntervalSet &set2) {
+  return combine(set1, set2, OPERATION_UNION);
+}
+
+IntervalSet IntervalSet::intersect(const IntervalSet &set1, const IntervalSet &set2) {
+  return combine(set1, set2, OPERATION_INTERSECTION);
+}
+
+IntervalSet IntervalSet::subtract(const IntervalSet &set1, const IntervalSet &set2) {
+  return combine(set1, set2, OPERATION_DIFFERENCE);
+}
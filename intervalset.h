@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "date.h"
+
+/** Set of [from, to) DateTime intervals
+ *  Kept as one sorted array of raw m_time bounds (from0, to0, from1, to1...)
+ *  of disjoint and not touching intervals. Point and overlap queries are
+ *  binary searches, set algebra is a single merge of two bound arrays.
+ */
+class IntervalSet {
+  std::vector<long long> m_bounds;
+
+  static IntervalSet combine(const IntervalSet &set1, const IntervalSet &set2, int operation);
+
+public:
+  /** Construct an empty set
+   */
+  IntervalSet();
+
+  /** Construct set as union of intervals
+   * /param from        Interval starts
+   * /param to          Interval ends (exclusive)
+   * /param count       Amount of the intervals
+   *  Invalid and empty intervals are ignored, the rest may overlap and come in any order
+   */
+  IntervalSet(const DateTime *from, const DateTime *to, size_t count);
+
+  /** Replace content with union of intervals
+   * /param from        Interval starts
+   * /param to          Interval ends (exclusive)
+   * /param count       Amount of the intervals
+   */
+  void assign(const DateTime *from, const DateTime *to, size_t count);
+
+  /** Add a single interval
+   *  Costs a pass over the set, use assign() or unite() for many intervals
+   */
+  void add(const DateTime &from, const DateTime &to);
+
+  /** Get amount of disjoint intervals
+   */
+  size_t size(void) const;
+
+  /** Check if the set is empty
+   */
+  bool empty(void) const;
+
+  /** Get start of an interval
+   */
+  DateTime getFrom(size_t index) const;
+
+  /** Get end of an interval (exclusive)
+   */
+  DateTime getTo(size_t index) const;
+
+  /** Check if the set contains the time
+   */
+  bool contains(const DateTime &time) const;
+
+  /** Check if the set has common points with [from, to)
+   */
+  bool overlaps(const DateTime &from, const DateTime &to) const;
+
+  /** Get total length of the intervals in milliseconds
+   */
+  long long getDuration(void) const;
+
+  /** Get total length of the intervals in whole days
+   *  Counted as DateTime::daysBetween() counts them
+   */
+  int getDays(void) const;
+
+  /** Get union of two sets
+   */
+  static IntervalSet unite(const IntervalSet &set1, const IntervalSet &set2);
+
+  /** Get intersection of two sets
+   */
+  static IntervalSet intersect(const IntervalSet &set1, const IntervalSet &set2);
+
+  /** Get points of the first set which are not in the second one
+   */
+  static IntervalSet subtract(const IntervalSet &set1, const IntervalSet &set2);
+
+  friend bool operator == (const IntervalSet &set1, const IntervalSet &set2);
+  friend bool operator != (const IntervalSet &set1, const IntervalSet &set2);
+};
+
+
+inline bool operator == (const IntervalSet &set1, const IntervalSet &set2) {
+  return set1.m_bounds == set2.m_bounds;
+}
+
+inline bool operator != (const IntervalSet &set1, const IntervalSet &set2) {
+  return !(set1 == set2);
+}
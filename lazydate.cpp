@@ -0,0 +1,174 @@
+#include "stdafx.h"
+#include "lazydate.h"
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+TextArena::TextArena(size_t blockSize):
+  m_blockSize(blockSize > 0 ? blockSize : 1),
+  m_used(0)
+{
+}
+
+TextArena::~TextArena() {
+  clear();
+}
+
+const char* TextArena::store(const char *text, size_t length) {
+  char *result;
+  if (length > m_blockSize / 4) {
+    // Long text gets its own block, put before the last one to keep filling it
+    result = static_cast<char*>(malloc(length > 0 ? length : 1));
+    m_blocks.insert(m_blocks.end() - (m_blocks.empty() ? 0 : 1), result);
+  } else {
+    if (m_blocks.empty() || m_blockSize - m_used < length) {
+      m_blocks.push_back(static_cast<char*>(malloc(m_blockSize)));
+      m_used = 0;
+    }
+    result = m_blocks.back() + m_used;
+    m_used += length;
+  }
+
+  memcpy(result, text, length);
+  return result;
+}
+
+void TextArena::clear(void) {
+  for (size_t i = 0; i < m_blocks.size(); i++)
+    free(m_blocks[i]);
+  m_blocks.clear();
+  m_used = 0;
+}
+
+//******************************
+
+LazyDateTime::LazyDateTime():
+  m_text(""),
+  m_length(0),
+  m_layout(DateTimeParser::LAYOUT_GENERIC),
+  m_parsed(true),
+  m_modified(false)
+{
+}
+
+LazyDateTime::LazyDateTime(const char *text, size_t length, DateTimeParser::Layout layout):
+  m_text(text),
+  m_length(length),
+  m_layout(layout),
+  m_parsed(false),
+  m_modified(false)
+{
+}
+
+LazyDateTime::LazyDateTime(const DateTime &value):
+  m_text(""),
+  m_length(0),
+  m_layout(DateTimeParser::LAYOUT_GENERIC),
+  m_value(value),
+  m_parsed(true),
+  m_modified(true)
+{
+}
+
+const DateTime& LazyDateTime::get(void) const {
+  if (!m_parsed) {
+    // Expected layout first, then the one the text looks like, then the generic parser
+    DateTimeParser parser(m_layout);
+    if (!parser.parseFast(m_text, m_length, m_value)) {
+      m_layout = DateTimeParser::detect(m_text, m_length);
+      m_value = DateTimeParser(m_layout).parse(m_text, m_length);
+    }
+    m_parsed = true;
+  }
+  return m_value;
+}
+
+DateTime& LazyDateTime::modify(void) {
+  // Arithmetic keeps invalid values invalid: their source text is still the best output
+  if (get().isValid()) m_modified = true;
+  return m_value;
+}
+
+void LazyDateTime::set(const DateTime &value) {
+  m_value = value;
+  m_parsed = true;
+  m_modified = true;
+}
+
+bool LazyDateTime::isParsed(void) const {
+  return m_parsed;
+}
+
+bool LazyDateTime::isModified(void) const {
+  return m_modified;
+}
+
+bool LazyDateTime::isValid(void) const {
+  return get().isValid();
+}
+
+DateTime::Fields LazyDateTime::getFields(void) const {
+  return get().getFields();
+}
+
+LazyDateTime& LazyDateTime::incSecond(int seconds) {
+  modify().incSecond(seconds);
+  return *this;
+}
+
+LazyDateTime& LazyDateTime::incMinute(int minutes) {
+  modify().incMinute(minutes);
+  return *this;
+}
+
+LazyDateTime& LazyDateTime::incHour(int hours) {
+  modify().incHour(hours);
+  return *this;
+}
+
+LazyDateTime& LazyDateTime::incDay(int days) {
+  modify().incDay(days);
+  return *this;
+}
+
+LazyDateTime& LazyDateTime::incMonth(int months) {
+  modify().incMonth(months);
+  return *this;
+}
+
+LazyDateTime& LazyDateTime::incYear(int years) {
+  modify().incYear(years);
+  return *this;
+}
+
+size_t LazyDateTime::getLength(void) const {
+  if (!m_modified) return m_length;
+  char buffer[DateTimeParser::MAX_LENGTH];
+  return write(buffer);
+}
+
+size_t LazyDateTime::write(char *buffer) const {
+  if (!m_modified) {
+    memcpy(buffer, m_text, m_length);
+    return m_length;
+  }
+  return DateTimeParser(m_layout).format(m_value, buffer);
+}
+
+void LazyDateTime::appendTo(string &text) const {
+  if (!m_modified) {
+    text.append(m_text, m_length);
+  } else {
+    char buffer[DateTimeParser::MAX_LENGTH];
+    text.append(buffer, write(buffer));
+  }
+}
+
+bool operator == (const LazyDateTime &date1, const LazyDateTime &date2) {
+  // Same untouched text means the same value, no parsing needed
+  if (!date1.m_modified && !date2.m_modified && date1.m_length == date2.m_length &&
+      memcmp(date1.m_text, date2.m_text, date1.m_length) == 0)
+    return true;
+  return date1.get() == date2.get();
+}
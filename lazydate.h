@@ -0,0 +1,147 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "date.h"
+#include "sniffer.h"
+
+/** Arena keeping backing text of LazyDateTime values
+ *  Text is copied into large blocks which are freed all at once
+ */
+class TextArena {
+  std::vector<char*> m_blocks;
+  size_t m_blockSize;
+  size_t m_used;          // bytes used in the last block
+
+  TextArena(const TextArena&);
+  const TextArena& operator= (const TextArena&);
+
+public:
+  /** Construct arena
+   * /param blockSize     Size of a memory block
+   */
+  explicit TextArena(size_t blockSize = 64 * 1024);
+
+  ~TextArena();
+
+  /** Copy text into the arena
+   * /result        Copy which lives till clear() or destruction (not zero-terminated)
+   */
+  const char* store(const char *text, size_t length);
+
+  /** Free all text
+   */
+  void clear(void);
+};
+
+
+/** DateTime parsed from its source text on first use
+ *  Keeps a non-owning view of the text: the text has to outlive the value
+ *  (see TextArena). Values never modified are written back as their
+ *  original bytes, so pass-through columns are never parsed or formatted.
+ *  Parsing caches the value in const methods: instances shared between
+ *  threads have to be parsed before sharing.
+ */
+class LazyDateTime {
+  const char *m_text;
+  size_t m_length;
+  mutable DateTimeParser::Layout m_layout;   // detected on parsing when the expected one fails
+  mutable DateTime m_value;
+  mutable bool m_parsed;
+  bool m_modified;
+
+  DateTime& modify(void);
+
+public:
+  /** Construct an invalid value
+   */
+  LazyDateTime();
+
+  /** Construct value of a text
+   * /param text        Date-time text (not necessarily zero-terminated)
+   * /param length      Length of the text
+   * /param layout      Layout the text is expected in, other layouts are detected on parsing
+   */
+  LazyDateTime(const char *text, size_t length, DateTimeParser::Layout layout = DateTimeParser::LAYOUT_GENERIC);
+
+  /** Construct value of a parsed DateTime (written as formatDateTime() does)
+   */
+  explicit LazyDateTime(const DateTime &value);
+
+  /** Get the value, parsing the text if not yet done
+   */
+  const DateTime& get(void) const;
+
+  /** Replace the value
+   */
+  void set(const DateTime &value);
+
+  /** Check whether the text has been parsed
+   */
+  bool isParsed(void) const;
+
+  /** Check whether the value has been changed since construction
+   */
+  bool isModified(void) const;
+
+  /** Check validity of the value
+   */
+  bool isValid(void) const;
+
+  /** Get calendar fields of the value
+   */
+  DateTime::Fields getFields(void) const;
+
+  /** Increase value as the DateTime methods of the same names do
+   *  Values whose text doesn't parse stay unmodified
+   */
+  LazyDateTime& incSecond(int seconds);
+  LazyDateTime& incMinute(int minutes);
+  LazyDateTime& incHour(int hours);
+  LazyDateTime& incDay(int days);
+  LazyDateTime& incMonth(int months);
+  LazyDateTime& incYear(int years);
+
+  /** Get length of the text write() produces
+   */
+  size_t getLength(void) const;
+
+  /** Write the value as text
+   *  Unmodified values give their source text. Modified ones are formatted
+   *  in the layout of the source (SQL format if it's unknown), years out of
+   *  1-9999 give no text
+   * /param buffer      Accepts getLength() characters (no zero is appended)
+   * /result            Amount of characters written
+   */
+  size_t write(char *buffer) const;
+
+  /** Append the value as write() gives it
+   */
+  void appendTo(std::string &text) const;
+
+  friend bool operator == (const LazyDateTime &date1, const LazyDateTime &date2);
+  friend bool operator < (const LazyDateTime &date1, const LazyDateTime &date2);
+};
+
+
+bool operator == (const LazyDateTime &date1, const LazyDateTime &date2);
+
+inline bool operator < (const LazyDateTime &date1, const LazyDateTime &date2) {
+  return date1.get() < date2.get();
+}
+
+inline bool operator != (const LazyDateTime &date1, const LazyDateTime &date2) {
+  return !(date1 == date2);
+}
+
+inline bool operator <= (const LazyDateTime &date1, const LazyDateTime &date2) {
+  return !(date2 < date1);
+}
+
+inline bool operator > (const LazyDateTime &date1, const LazyDateTime &date2) {
+  return date2 < date1;
+}
+
+inline bool operator >= (const LazyDateTime &date1, const LazyDateTime &date2) {
+  return !(date1 < date2);
+}
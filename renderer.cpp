@@ -0,0 +1,78 @@
+#include "stdafx.h"
+#include "renderer.h"
+#include "dateconst.h"
+#include <climits>
+#include <cstring>
+
+using namespace std;
+
+// Field positions in "yyyy-MM-dd hh:mm:ss.fff"
+const int HOUR_POS = 11;
+const int MINUTE_POS = 14;
+const int SECOND_POS = 17;
+const int MILLISECOND_POS = 20;
+
+inline void put2(char *buffer, int value) {
+  buffer[0] = static_cast<char>('0' + value / 10);
+  buffer[1] = static_cast<char>('0' + value % 10);
+}
+
+inline void put3(char *buffer, int value) {
+  buffer[0] = static_cast<char>('0' + value / 100);
+  put2(buffer + 1, value % 100);
+}
+
+TimestampRenderer::TimestampRenderer():
+  m_last(LLONG_MIN),
+  m_dayStart(LLONG_MIN)
+{
+  memcpy(m_buffer, "0000-00-00 00:00:00.000", LENGTH + 1);
+}
+
+bool TimestampRenderer::renderFull(const DateTime &time) {
+  // Years the 4-digit field can't hold; the rest are from the year 1, so raw is not negative
+  DateTime::Fields fields = time.getFields();
+  if (fields.year < 1 || fields.year > 9999) return false;
+
+  put2(m_buffer, fields.year / 100);
+  put2(m_buffer + 2, fields.year % 100);
+  put2(m_buffer + 5, fields.month);
+  put2(m_buffer + 8, fields.day);
+  put2(m_buffer + HOUR_POS, fields.hour);
+  put2(m_buffer + MINUTE_POS, fields.minute);
+  put2(m_buffer + SECOND_POS, fields.second);
+  put3(m_buffer + MILLISECOND_POS, fields.millisecond);
+
+  long long raw = time.getRaw();
+  m_dayStart = raw - raw % MILLISECS_IN_DAY;
+  return true;
+}
+
+const char* TimestampRenderer::render(const DateTime &time) {
+  long long raw = time.getRaw();
+  if (raw == LLONG_MIN) return "";
+
+  if (m_last == LLONG_MIN || raw < m_last || raw - m_dayStart >= MILLISECS_IN_DAY) {
+    if (!renderFull(time)) {
+      m_last = LLONG_MIN;
+      return "";
+    }
+  } else if (raw != m_last) {
+    // Same day, forward: fields from the milliseconds up to the first unchanged one
+    long long now = raw - m_dayStart;
+    long long before = m_last - m_dayStart;
+
+    put3(m_buffer + MILLISECOND_POS, static_cast<int>(now % MILLISECS_IN_SECOND));
+    if (now / MILLISECS_IN_SECOND != before / MILLISECS_IN_SECOND) {
+      put2(m_buffer + SECOND_POS, static_cast<int>(now % MILLISECS_IN_MINUTE / MILLISECS_IN_SECOND));
+      if (now / MILLISECS_IN_MINUTE != before / MILLISECS_IN_MINUTE) {
+        put2(m_buffer + MINUTE_POS, static_cast<int>(now % MILLISECS_IN_HOUR / MILLISECS_IN_MINUTE));
+        if (now / MILLISECS_IN_HOUR != before / MILLISECS_IN_HOUR)
+          put2(m_buffer + HOUR_POS, static_cast<int>(now / MILLISECS_IN_HOUR));
+      }
+    }
+  }
+
+  m_last = raw;
+  return m_buffer;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include "date.h"
+
+/** Renders "yyyy-MM-dd hh:mm:ss.fff" stamps for mostly increasing times
+ *  Keeps the last stamp and rewrites only the time fields which changed
+ *  since it. A full render (one calendar decomposition) happens on the
+ *  first call, on a day change and when the time goes backwards.
+ */
+class TimestampRenderer {
+  char m_buffer[24];
+  long long m_last;         // last rendered value, LLONG_MIN if none
+  long long m_dayStart;     // start of the day of m_last
+
+  bool renderFull(const DateTime &time);
+
+public:
+  /** Length of a stamp
+   */
+  static const size_t LENGTH = 23;
+
+  TimestampRenderer();
+
+  /** Render time stamp
+   * /param time        Time to render
+   * /result            Zero-terminated stamp of LENGTH characters, valid till the next call;
+   *                    empty string for invalid time and years out of 1-9999
+   */
+  const char* render(const DateTime &time);
+};
@@ -0,0 +1,306 @@
+#include "stdafx.h"
+#include "scheduler.h"
+#include "dateconst.h"
+#include <climits>
+
+using namespace std;
+
+// Bits of the clock per wheel and slots in a wheel
+const int WHEEL_BITS = 6;
+const int WHEEL_SLOTS = 1 << WHEEL_BITS;
+
+// Wheels needed for 64 bits, the last one has 4 bits only
+const int WHEEL_COUNT = (64 + WHEEL_BITS - 1) / WHEEL_BITS;
+
+// End of a slot list
+const unsigned int NIL = UINT_MAX;
+
+/** Index of the highest 1 bit of a non-zero value
+ */
+inline int highestBit(unsigned long long value) {
+#ifdef __GNUC__
+  return 63 - __builtin_clzll(value);
+#else
+  int result = 0;
+  while (value >>= 1) result++;
+  return result;
+#endif
+}
+
+/** Index of the lowest 1 bit of a non-zero value
+ */
+inline int lowestBit(unsigned long long value) {
+#ifdef __GNUC__
+  return __builtin_ctzll(value);
+#else
+  int result = 0;
+  while (!(value & 1)) {
+    value >>= 1;
+    result++;
+  }
+  return result;
+#endif
+}
+
+/** Clock bits above the wheel (zero for the last wheel)
+ */
+inline unsigned long long upperBits(unsigned long long key, int level) {
+  int shift = (level + 1) * WHEEL_BITS;
+  return shift >= 64 ? 0 : (key >> shift) << shift;
+}
+
+inline int slotOf(unsigned long long key, int level) {
+  return static_cast<int>((key >> (level * WHEEL_BITS)) & (WHEEL_SLOTS - 1));
+}
+
+/** Handle is the generation in the high half and index + 1 in the low one
+ */
+inline DateTimeScheduler::Handle makeHandle(unsigned int index, unsigned int generation) {
+  return (static_cast<unsigned long long>(generation) << 32) | (index + 1ULL);
+}
+
+//******************************
+DateTimeScheduler::DateTimeScheduler(const DateTime &now):
+  m_heads(WHEEL_COUNT * WHEEL_SLOTS, NIL),
+  m_tails(WHEEL_COUNT * WHEEL_SLOTS, NIL),
+  m_now(toKey(now.getRaw())),
+  m_size(0),
+  m_posted(nullptr)
+{
+  for (int i = 0; i < WHEEL_COUNT; i++)
+    m_bitmaps[i] = 0;
+}
+
+DateTimeScheduler::~DateTimeScheduler() {
+  Posted *posted = m_posted.exchange(nullptr);
+  while (posted) {
+    Posted *next = posted->next;
+    delete posted;
+    posted = next;
+  }
+}
+
+DateTimeScheduler::Node* DateTimeScheduler::find(Handle handle) {
+  unsigned int index = static_cast<unsigned int>(handle & 0xFFFFFFFF) - 1;
+  if (index >= m_nodes.size()) return nullptr;
+
+  Node &node = m_nodes[index];
+  if (node.bucket < 0 || node.generation != static_cast<unsigned int>(handle >> 32))
+    return nullptr;
+  return &node;
+}
+
+const DateTimeScheduler::Node* DateTimeScheduler::find(Handle handle) const {
+  return const_cast<DateTimeScheduler*>(this)->find(handle);
+}
+
+void DateTimeScheduler::link(unsigned int index) {
+  Node &node = m_nodes[index];
+
+  // Overdue jobs go to the current slot of the lowest wheel
+  unsigned long long key = toKey(node.deadline);
+  if (key < m_now) key = m_now;
+
+  unsigned long long diff = key ^ m_now;
+  int level = diff ? highestBit(diff) / WHEEL_BITS : 0;
+  int slot = slotOf(key, level);
+  int bucket = level * WHEEL_SLOTS + slot;
+
+  // Slots are FIFO so jobs due at the same time expire in scheduling order
+  node.bucket = bucket;
+  node.next = NIL;
+  node.prev = m_tails[bucket];
+  if (node.prev == NIL)
+    m_heads[bucket] = index;
+  else
+    m_nodes[node.prev].next = index;
+  m_tails[bucket] = index;
+
+  m_bitmaps[level] |= 1ULL << slot;
+}
+
+void DateTimeScheduler::unlink(unsigned int index) {
+  Node &node = m_nodes[index];
+  int bucket = node.bucket;
+
+  if (node.prev == NIL)
+    m_heads[bucket] = node.next;
+  else
+    m_nodes[node.prev].next = node.next;
+
+  if (node.next == NIL)
+    m_tails[bucket] = node.prev;
+  else
+    m_nodes[node.next].prev = node.prev;
+
+  if (m_heads[bucket] == NIL)
+    m_bitmaps[bucket / WHEEL_SLOTS] &= ~(1ULL << (bucket % WHEEL_SLOTS));
+}
+
+DateTimeScheduler::Handle DateTimeScheduler::schedule(const DateTime &deadline, unsigned long long payload) {
+  if (!deadline.isValid()) return 0;
+
+  unsigned int index;
+  if (m_free.empty()) {
+    index = static_cast<unsigned int>(m_nodes.size());
+    Node node = {0, 0, NIL, NIL, 0, -1};
+    m_nodes.push_back(node);
+  } else {
+    index = m_free.back();
+    m_free.pop_back();
+  }
+
+  Node &node = m_nodes[index];
+  node.deadline = deadline.getRaw();
+  node.payload = payload;
+  link(index);
+  m_size++;
+
+  return makeHandle(index, node.generation);
+}
+
+void DateTimeScheduler::post(const DateTime &deadline, unsigned long long payload) {
+  if (!deadline.isValid()) return;
+
+  Posted *posted = new Posted;
+  posted->deadline = deadline.getRaw();
+  posted->payload = payload;
+  posted->next = m_posted.load(memory_order_relaxed);
+  while (!m_posted.compare_exchange_weak(posted->next, posted, memory_order_release, memory_order_relaxed))
+    ;
+}
+
+void DateTimeScheduler::drainPosted(void) {
+  Posted *posted = m_posted.exchange(nullptr, memory_order_acquire);
+
+  // The stack is in reverse posting order
+  Posted *ordered = nullptr;
+  while (posted) {
+    Posted *next = posted->next;
+    posted->next = ordered;
+    ordered = posted;
+    posted = next;
+  }
+
+  while (ordered) {
+    Posted *next = ordered->next;
+    DateTime deadline;
+    deadline.setRaw(ordered->deadline);
+    schedule(deadline, ordered->payload);
+    delete ordered;
+    ordered = next;
+  }
+}
+
+bool DateTimeScheduler::cancel(Handle handle) {
+  Node *node = find(handle);
+  if (!node) return false;
+
+  unsigned int index = static_cast<unsigned int>(node - &m_nodes[0]);
+  unlink(index);
+  node->bucket = -1;
+  node->generation++;
+  m_free.push_back(index);
+  m_size--;
+  return true;
+}
+
+bool DateTimeScheduler::reschedule(Handle handle, const DateTime &deadline) {
+  Node *node = find(handle);
+  if (!node || !deadline.isValid()) return false;
+
+  unsigned int index = static_cast<unsigned int>(node - &m_nodes[0]);
+  unlink(index);
+  node->deadline = deadline.getRaw();
+  link(index);
+  return true;
+}
+
+bool DateTimeScheduler::rescheduleMonths(Handle handle, int months) {
+  DateTime deadline = getDeadline(handle);
+  return reschedule(handle, deadline.incMonth(months));
+}
+
+bool DateTimeScheduler::rescheduleYears(Handle handle, int years) {
+  DateTime deadline = getDeadline(handle);
+  return reschedule(handle, deadline.incYear(years));
+}
+
+DateTime DateTimeScheduler::getDeadline(Handle handle) const {
+  DateTime result;
+  const Node *node = find(handle);
+  if (node) result.setRaw(node->deadline);
+  return result;
+}
+
+size_t DateTimeScheduler::expire(const DateTime &now, std::vector<Job> &jobs) {
+  drainPosted();
+
+  // Earlier (or invalid) times expire what is due by the current time
+  size_t result = 0;
+  unsigned long long target = toKey(now.getRaw());
+  if (!now.isValid() || target < m_now) target = m_now;
+
+  for (;;) {
+    // The earliest non-empty slot: lower wheels come before the higher ones.
+    //  Higher wheels never hold jobs in the current slot, they are moved down
+    //  when the time reaches it
+    int level = 0;
+    unsigned long long pending = 0;
+    for (; level < WHEEL_COUNT; level++) {
+      int current = slotOf(m_now, level);
+      unsigned long long mask = ~0ULL << current;
+      if (level > 0) mask <<= 1;
+      pending = m_bitmaps[level] & mask;
+      if (pending) break;
+    }
+    if (!pending) break;
+
+    int slot = lowestBit(pending);
+    unsigned long long start = upperBits(m_now, level)
+      | (static_cast<unsigned long long>(slot) << (level * WHEEL_BITS));
+    if (start > target) break;
+
+    m_now = start;
+    int bucket = level * WHEEL_SLOTS + slot;
+    unsigned int index = m_heads[bucket];
+    m_heads[bucket] = m_tails[bucket] = NIL;
+    m_bitmaps[level] &= ~(1ULL << slot);
+
+    while (index != NIL) {
+      Node &node = m_nodes[index];
+      unsigned int next = node.next;
+
+      if (level == 0) {
+        Job job;
+        job.deadline.setRaw(node.deadline);
+        job.payload = node.payload;
+        job.handle = makeHandle(index, node.generation);
+        jobs.push_back(job);
+        result++;
+
+        node.bucket = -1;
+        node.generation++;
+        m_free.push_back(index);
+        m_size--;
+      } else
+        link(index);    // lands on a lower wheel
+
+      index = next;
+    }
+  }
+
+  // Every job left is due after the target, so the wheels stay consistent
+  if (target > m_now) m_now = target;
+  return result;
+}
+
+DateTime DateTimeScheduler::getNow(void) const {
+  DateTime result;
+  result.setRaw(fromKey(m_now));
+  return result;
+}
+
+size_t DateTimeScheduler::size(void) const {
+  return m_size;
+}
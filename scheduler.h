@@ -0,0 +1,133 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include "date.h"
+
+/** Deadline scheduler built on a hierarchical timing wheel
+ *  Eleven wheels of 64 slots cover all 64 bits of the millisecond clock:
+ *  a job goes to the wheel of the highest bit where its deadline differs
+ *  from the current time. Scheduling and cancelling are O(1), expiring
+ *  walks only non-empty slots (found by per-wheel occupancy bitmaps) and
+ *  moves each job down at most once per wheel.
+ *
+ *  Only post() may be called concurrently (from any amount of threads),
+ *  everything else belongs to the thread owning the scheduler.
+ */
+class DateTimeScheduler {
+public:
+  /** Job identifier, zero is never a valid handle
+   */
+  typedef unsigned long long Handle;
+
+  /** Expired job
+   */
+  struct Job {
+    DateTime deadline;
+    unsigned long long payload;
+    Handle handle;
+  };
+
+private:
+  /** Pooled job, linked into a wheel slot
+   */
+  struct Node {
+    long long deadline;
+    unsigned long long payload;
+    unsigned int prev;
+    unsigned int next;
+    unsigned int generation;
+    int bucket;                     // level * 64 + slot, -1 for a free node
+  };
+
+  /** Job posted by another thread
+   */
+  struct Posted {
+    long long deadline;
+    unsigned long long payload;
+    Posted *next;
+  };
+
+  std::vector<Node> m_nodes;
+  std::vector<unsigned int> m_free;
+  std::vector<unsigned int> m_heads;
+  std::vector<unsigned int> m_tails;
+  unsigned long long m_bitmaps[11];
+  unsigned long long m_now;           // sign-flipped raw time
+  size_t m_size;
+  std::atomic<Posted*> m_posted;
+
+  // Copying would need draining of posted jobs
+  DateTimeScheduler(const DateTimeScheduler&);
+  const DateTimeScheduler& operator= (const DateTimeScheduler&);
+
+  Node* find(Handle handle);
+  const Node* find(Handle handle) const;
+  void link(unsigned int index);
+  void unlink(unsigned int index);
+  void drainPosted(void);
+
+public:
+  /** Construct scheduler
+   * /param now       Current time, jobs due by it expire on the first expire()
+   */
+  explicit DateTimeScheduler(const DateTime &now);
+
+  ~DateTimeScheduler();
+
+  /** Schedule a job
+   * /param deadline  Time the job is due
+   * /param payload   Caller's job identifier
+   * /result          Job handle or zero for invalid deadline
+   */
+  Handle schedule(const DateTime &deadline, unsigned long long payload);
+
+  /** Schedule a job from any thread
+   *  Posted jobs join the wheel on the next expire() and get no handle
+   * /param deadline  Time the job is due (jobs with invalid deadline are dropped)
+   * /param payload   Caller's job identifier
+   */
+  void post(const DateTime &deadline, unsigned long long payload);
+
+  /** Cancel a scheduled job
+   * /result          False if the job has already expired or was cancelled
+   */
+  bool cancel(Handle handle);
+
+  /** Move a scheduled job to another deadline, the handle stays valid
+   * /result          False if the job is not scheduled or the deadline is invalid
+   */
+  bool reschedule(Handle handle, const DateTime &deadline);
+
+  /** Move a scheduled job by months as DateTime::incMonth() does
+   * /result          False if the job is not scheduled
+   */
+  bool rescheduleMonths(Handle handle, int months);
+
+  /** Move a scheduled job by years as DateTime::incYear() does
+   * /result          False if the job is not scheduled
+   */
+  bool rescheduleYears(Handle handle, int years);
+
+  /** Get deadline of a scheduled job
+   * /result          Invalid DateTime if the job is not scheduled
+   */
+  DateTime getDeadline(Handle handle) const;
+
+  /** Advance current time and collect the jobs due by it
+   *  Jobs are appended in deadline order. Time never goes back:
+   *   earlier values only collect the jobs due by the current time.
+   * /param now       New current time
+   * /param jobs      Accepts the expired jobs
+   * /result          Amount of jobs appended
+   */
+  size_t expire(const DateTime &now, std::vector<Job> &jobs);
+
+  /** Get current time of the scheduler
+   */
+  DateTime getNow(void) const;
+
+  /** Get amount of scheduled jobs (posted ones are counted after expire())
+   */
+  size_t size(void) const;
+};
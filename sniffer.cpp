@@ -0,0 +1,238 @@
+#include "stdafx.h"
+#include "sniffer.h"
+#include <cstring>
+
+using namespace std;
+
+/** Description of a fixed layout
+ *  Pattern has '#' for a digit and literal separators elsewhere,
+ *  positions of absent fields are -1
+ */
+struct LayoutSpec {
+  const char *pattern;
+  size_t length;
+  int yearPos;
+  int monthPos;
+  int dayPos;
+  int hourPos;
+  int minutePos;
+  int secondPos;
+  int millisecondPos;
+};
+
+// Indexed by DateTimeParser::Layout
+const LayoutSpec LAYOUTS[DateTimeParser::LAYOUT_COUNT] = {
+  {"",                        0,  -1, -1, -1, -1, -1, -1, -1},
+  {"####-##-##",              10,  0,  5,  8, -1, -1, -1, -1},
+  {"####-##-## ##:##:##",     19,  0,  5,  8, 11, 14, 17, -1},
+  {"####-##-## ##:##:##.###", 23,  0,  5,  8, 11, 14, 17, 20},
+  {"####-##-##T##:##:##",     19,  0,  5,  8, 11, 14, 17, -1},
+  {"####-##-##T##:##:##.###", 23,  0,  5,  8, 11, 14, 17, 20},
+  {"##.##.####",              10,  6,  3,  0, -1, -1, -1, -1},
+  {"##.##.#### ##:##:##",     19,  6,  3,  0, 11, 14, 17, -1}
+};
+
+const int DAYS_IN_MONTH[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+/** Check that the value has digits and separators exactly where the layout wants them
+ */
+inline bool fits(const LayoutSpec &spec, const char *value, size_t length) {
+  if (length != spec.length) return false;
+
+  bool result = true;
+  for (size_t i = 0; i < length; i++) {
+    char c = value[i];
+    if (spec.pattern[i] == '#')
+      result &= static_cast<unsigned>(c - '0') < 10;
+    else
+      result &= c == spec.pattern[i];
+  }
+  return result;
+}
+
+/** Check for a "d.M." / "dd.MM." prefix which the generic parser would read as a year
+ */
+inline bool isDayFirst(const char *value, size_t length) {
+  size_t i = 0;
+  for (int part = 0; part < 2; part++) {
+    size_t start = i;
+    while (i < length && i - start < 3 && static_cast<unsigned>(value[i] - '0') < 10) i++;
+    if (i == start || i - start > 2 || i >= length || value[i] != '.') return false;
+    i++;
+  }
+  return true;
+}
+
+inline int digits2(const char *value) {
+  return (value[0] - '0') * 10 + (value[1] - '0');
+}
+
+inline int digits3(const char *value) {
+  return (value[0] - '0') * 100 + digits2(value + 1);
+}
+
+inline int digits4(const char *value) {
+  return digits2(value) * 100 + digits2(value + 2);
+}
+
+inline void putDigits(char *buffer, int value, int count) {
+  for (int i = count - 1; i >= 0; i--) {
+    buffer[i] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  }
+}
+
+//******************************
+DateTimeParser::DateTimeParser(Layout layout):
+  m_layout(layout)
+{}
+
+DateTimeParser::Layout DateTimeParser::getLayout(void) const {
+  return m_layout;
+}
+
+bool DateTimeParser::parseFast(const char *value, size_t length, DateTime &result) const {
+  if (m_layout == LAYOUT_GENERIC) return false;
+
+  const LayoutSpec &spec = LAYOUTS[m_layout];
+  if (!fits(spec, value, length)) return false;
+
+  DateTime::Fields fields;
+  fields.year = digits4(value + spec.yearPos);
+  fields.month = digits2(value + spec.monthPos);
+  fields.day = digits2(value + spec.dayPos);
+
+  if (spec.hourPos >= 0) {
+    fields.hour = digits2(value + spec.hourPos);
+    fields.minute = digits2(value + spec.minutePos);
+    fields.second = digits2(value + spec.secondPos);
+  } else {
+    fields.hour = fields.minute = fields.second = 0;
+  }
+
+  if (spec.millisecondPos >= 0)
+    fields.millisecond = digits3(value + spec.millisecondPos);
+  else
+    fields.millisecond = 0;
+
+  // Out of range values don't fit
+  if (fields.year < 1 || fields.month < 1 || fields.month > 12
+    || fields.day < 1 || fields.day > DAYS_IN_MONTH[fields.month - 1]
+    || (fields.month == 2 && fields.day == 29 && !DateTime::isLeapYear(fields.year))
+    || fields.hour > 23 || fields.minute > 59 || fields.second > 59)
+      return false;
+
+  fields.valid = true;
+  result.set(fields);
+  return true;
+}
+
+DateTime DateTimeParser::parse(const char *value, size_t length) const {
+  Layout layout;
+  return parse(value, length, layout);
+}
+
+DateTime DateTimeParser::parse(const char *value, size_t length, Layout &layout) const {
+  DateTime result;
+  layout = m_layout;
+  if (parseFast(value, length, result)) return result;
+
+  // An odd value: try other layouts before the generic parser
+  layout = detect(value, length);
+  if (layout != LAYOUT_GENERIC) {
+    DateTimeParser(layout).parseFast(value, length, result);
+    return result;
+  }
+
+  // The generic parser reads the first number as the year: day-first text and
+  //  text shaped as a fixed layout with out of range fields stay invalid
+  if (m_layout == LAYOUT_DMY || m_layout == LAYOUT_DMY_TIME || isDayFirst(value, length))
+    return result;
+  for (int i = LAYOUT_GENERIC + 1; i < LAYOUT_COUNT; i++)
+    if (fits(LAYOUTS[i], value, length)) return result;
+
+  result.set(string(value, length));
+  return result;
+}
+
+DateTime DateTimeParser::parse(const std::string &value) const {
+  return parse(value.data(), value.size());
+}
+
+size_t DateTimeParser::format(const DateTime &value, char *buffer) const {
+  if (!value.isValid()) return 0;
+
+  // Years take exactly 4 digits so that the text parses back with the same layout
+  DateTime::Fields fields = value.getFields();
+  if (fields.year < 1 || fields.year > 9999) return 0;
+
+  const LayoutSpec *spec;
+  if (m_layout == LAYOUT_GENERIC) {
+    // As formatDateTime(): milliseconds only when there are some
+    spec = &LAYOUTS[fields.millisecond ? LAYOUT_DATETIME_MS : LAYOUT_DATETIME];
+  } else
+    spec = &LAYOUTS[m_layout];
+
+  memcpy(buffer, spec->pattern, spec->length);
+  putDigits(buffer + spec->yearPos, fields.year, 4);
+  putDigits(buffer + spec->monthPos, fields.month, 2);
+  putDigits(buffer + spec->dayPos, fields.day, 2);
+
+  if (spec->hourPos >= 0) {
+    putDigits(buffer + spec->hourPos, fields.hour, 2);
+    putDigits(buffer + spec->minutePos, fields.minute, 2);
+    putDigits(buffer + spec->secondPos, fields.second, 2);
+  }
+
+  if (spec->millisecondPos >= 0)
+    putDigits(buffer + spec->millisecondPos, fields.millisecond, 3);
+
+  return spec->length;
+}
+
+DateTimeParser::Layout DateTimeParser::detect(const char *value, size_t length) {
+  DateTime dummy;
+  for (int i = LAYOUT_GENERIC + 1; i < LAYOUT_COUNT; i++) {
+    DateTimeParser parser(static_cast<Layout>(i));
+    if (parser.parseFast(value, length, dummy))
+      return static_cast<Layout>(i);
+  }
+  return LAYOUT_GENERIC;
+}
+
+//******************************
+DateTimeSniffer::DateTimeSniffer(int sampleSize):
+  m_wanted(sampleSize > 0 ? sampleSize : 1),
+  m_sampled(0)
+{
+  memset(m_counts, 0, sizeof(m_counts));
+}
+
+bool DateTimeSniffer::sample(const char *value, size_t length) {
+  if (length > 0 && m_sampled < m_wanted) {
+    m_counts[DateTimeParser::detect(value, length)]++;
+    m_sampled++;
+  }
+  return m_sampled < m_wanted;
+}
+
+bool DateTimeSniffer::sample(const std::string &value) {
+  return sample(value.data(), value.size());
+}
+
+bool DateTimeSniffer::ready(void) const {
+  return m_sampled >= m_wanted;
+}
+
+DateTimeParser::Layout DateTimeSniffer::getLayout(void) const {
+  // Generic layout wins only if nothing else was seen
+  int best = DateTimeParser::LAYOUT_GENERIC;
+  for (int i = DateTimeParser::LAYOUT_GENERIC + 1; i < DateTimeParser::LAYOUT_COUNT; i++)
+    if (m_counts[i] > m_counts[best] || (best == DateTimeParser::LAYOUT_GENERIC && m_counts[i] > 0))
+      best = i;
+  return static_cast<DateTimeParser::Layout>(best);
+}
+
+DateTimeParser DateTimeSniffer::getParser(void) const {
+  return DateTimeParser(getLayout());
+}
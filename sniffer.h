@@ -0,0 +1,129 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include "date.h"
+
+/** Parser specialized for a single fixed date-time layout
+ *  Values which don't fit the layout are handed to the other layouts
+ *  and finally to the generic DateTime(const std::string&) parser.
+ *  Day-first text and text shaped as a fixed layout with out of range
+ *  fields (2017-02-29, 32.01.2017) are invalid rather than generic.
+ */
+class DateTimeParser {
+public:
+  /** Known fixed layouts
+   */
+  enum Layout {
+    LAYOUT_GENERIC,       // anything: parsed by DateTime::set(const std::string&)
+    LAYOUT_DATE,          // yyyy-MM-dd
+    LAYOUT_DATETIME,      // yyyy-MM-dd hh:mm:ss
+    LAYOUT_DATETIME_MS,   // yyyy-MM-dd hh:mm:ss.fff
+    LAYOUT_ISO,           // yyyy-MM-ddThh:mm:ss
+    LAYOUT_ISO_MS,        // yyyy-MM-ddThh:mm:ss.fff
+    LAYOUT_DMY,           // dd.MM.yyyy
+    LAYOUT_DMY_TIME,      // dd.MM.yyyy hh:mm:ss
+    LAYOUT_COUNT
+  };
+
+private:
+  Layout m_layout;
+
+public:
+  /** Construct parser for the layout
+   * /param layout      Layout of the values to parse
+   */
+  explicit DateTimeParser(Layout layout = LAYOUT_GENERIC);
+
+  /** Get layout this parser is specialized for
+   */
+  Layout getLayout(void) const;
+
+  /** Parse value only if it fits the layout exactly
+   * /param value       Date-time text (not necessarily zero-terminated)
+   * /param length      Length of the text
+   * /param result      Accepts parsed value
+   * /result            False if the value doesn't fit the layout (result is untouched)
+   */
+  bool parseFast(const char *value, size_t length, DateTime &result) const;
+
+  /** Parse value. When it doesn't fit the layout other fixed layouts are tried,
+   *  then the generic parser (except for day-first text and DMY parsers)
+   * /param value       Date-time text (not necessarily zero-terminated)
+   * /param length      Length of the text
+   */
+  DateTime parse(const char *value, size_t length) const;
+
+  /** Parse value as parse(value, length) does and report how
+   * /param layout      Accepts the layout the value matched,
+   *                    LAYOUT_GENERIC for the generic parser and invalid values
+   */
+  DateTime parse(const char *value, size_t length, Layout &layout) const;
+
+  /** Parse value. When it doesn't fit the layout other fixed layouts are tried,
+   *  then the generic parser (except for day-first text and DMY parsers)
+   */
+  DateTime parse(const std::string &value) const;
+
+  /** Format value in the layout of this parser
+   *  Generic layout gives the SQL layout of DateTime::formatDateTime(),
+   *  but the year is always zero-padded to 4 digits (0099-01-01)
+   * /param value       Value to format
+   * /param buffer      Output buffer, at least MAX_LENGTH characters (no zero is appended)
+   * /result            Amount of characters written, zero for invalid values
+   *                    and years out of 1-9999
+   */
+  size_t format(const DateTime &value, char *buffer) const;
+
+  /** Longest text format() can produce
+   */
+  static const size_t MAX_LENGTH = 23;
+
+  /** Detect layout of a single value
+   * /result            Matching layout or LAYOUT_GENERIC if none fits
+   */
+  static Layout detect(const char *value, size_t length);
+};
+
+
+/** Detects date-time layout of a column by its first values
+ *  Usage: feed values with sample() while it returns true,
+ *   then take getParser() for the rest of the column
+ */
+class DateTimeSniffer {
+  int m_wanted;
+  int m_sampled;
+  int m_counts[DateTimeParser::LAYOUT_COUNT];
+
+public:
+  /** Default amount of values to inspect
+   */
+  static const int DEFAULT_SAMPLE_SIZE = 16;
+
+  /** Construct sniffer
+   * /param sampleSize    Amount of values to inspect before choosing the layout
+   */
+  explicit DateTimeSniffer(int sampleSize = DEFAULT_SAMPLE_SIZE);
+
+  /** Inspect next value of the column. Empty values are ignored
+   * /result        True if more values are wanted
+   */
+  bool sample(const char *value, size_t length);
+
+  /** Inspect next value of the column. Empty values are ignored
+   * /result        True if more values are wanted
+   */
+  bool sample(const std::string &value);
+
+  /** Check whether enough values have been inspected
+   */
+  bool ready(void) const;
+
+  /** Get the layout most of the inspected values fit
+   * /result        Detected layout or LAYOUT_GENERIC if nothing fits
+   */
+  DateTimeParser::Layout getLayout(void) const;
+
+  /** Get parser specialized for the detected layout
+   */
+  DateTimeParser getParser(void) const;
+};
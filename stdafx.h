@@ -5,10 +5,19 @@
 
 #pragma once
 
-#include "targetver.h"
+#ifdef WIN32
+  #include "targetver.h"
 
-#include <stdio.h>
-#include <tchar.h>
+  #include <stdio.h>
+  #include <tchar.h>
+#else
+  #include <stdio.h>
+  #include <string.h>
+
+  // Console entry point without Windows' TCHAR machinery
+  #define _tmain main
+  typedef char _TCHAR;
+#endif
 
 
 
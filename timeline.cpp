@@ -0,0 +1,504 @@
+#include "stdafx.h"
+#include "timeline.h"
+#include <climits>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define TIMELINE_X86_KERNELS
+  #include <immintrin.h>
+#endif
+
+using namespace std;
+
+typedef unsigned long long Word;
+
+// Blocks are decoded straight into DateTime arrays as raw m_time values
+static_assert(sizeof(DateTime) == sizeof(Word), "DateTime must hold m_time only");
+
+// "DTTL" and format version in the first word
+const Word IMAGE_MAGIC = 0x4C545444;
+const Word IMAGE_VERSION = 1;
+
+// Header: magic/version, value count, block count, image size in words
+const size_t HEADER_WORDS = 4;
+
+// Largest piece of an image read() allocates before receiving it
+const size_t READ_STEP_WORDS = 64 * 1024;
+
+// Directory entry: min, max, payload offset, info
+const size_t ENTRY_WORDS = 4;
+const size_t ENTRY_MIN = 0;
+const size_t ENTRY_MAX = 1;
+const size_t ENTRY_OFFSET = 2;
+const size_t ENTRY_INFO = 3;
+
+// Packed differences
+const int MODE_DELTA = 0;           // deltas from the previous value
+const int MODE_DELTA_OF_DELTA = 1;  // deltas from the previous delta
+
+/** Pack block info word
+ */
+inline Word makeInfo(size_t count, int width, int mode) {
+  return count | (static_cast<Word>(width) << 16) | (static_cast<Word>(mode) << 24);
+}
+
+inline size_t infoCount(Word info) {
+  return static_cast<size_t>(info & 0xFFFF);
+}
+
+inline int infoWidth(Word info) {
+  return static_cast<int>((info >> 16) & 0xFF);
+}
+
+inline int infoMode(Word info) {
+  return static_cast<int>((info >> 24) & 0xFF);
+}
+
+/** Amount of bits needed for the value
+ */
+inline int bitWidth(Word value) {
+  int result = 0;
+  while (value) {
+    value >>= 1;
+    result++;
+  }
+  return result;
+}
+
+/** Amount of words taken by count values of width bits
+ */
+inline size_t packedWords(size_t count, int width) {
+  return (count * width + 63) / 64;
+}
+
+/** Payload size: first value, reference, [first delta], packed words and a padding word
+ */
+inline size_t payloadWords(size_t count, int width, int mode) {
+  size_t residuals = count - 1 - (mode == MODE_DELTA_OF_DELTA ? 1 : 0);
+  return 2 + (mode == MODE_DELTA_OF_DELTA ? 1 : 0) + packedWords(residuals, width) + 1;
+}
+
+/** Subtract minimum from the differences and find their width
+ * /param diffs       Differences, replaced with residuals
+ * /param count       Amount of the differences
+ * /param reference   Accepts the minimum
+ * /result            Bit width of the residuals
+ */
+int makeResiduals(Word *diffs, size_t count, Word &reference) {
+  long long least = LLONG_MAX;
+  for (size_t i = 0; i < count; i++)
+    if (static_cast<long long>(diffs[i]) < least) least = static_cast<long long>(diffs[i]);
+
+  reference = count ? static_cast<Word>(least) : 0;
+
+  Word all = 0;
+  for (size_t i = 0; i < count; i++) {
+    diffs[i] -= reference;
+    all |= diffs[i];
+  }
+  return bitWidth(all);
+}
+
+void pack(const Word *values, size_t count, int width, Word *out) {
+  if (width == 0) return;
+  for (size_t i = 0; i < count; i++) {
+    size_t bit = i * width;
+    size_t word = bit >> 6;
+    int shift = static_cast<int>(bit & 63);
+    out[word] |= values[i] << shift;
+    if (shift + width > 64)
+      out[word + 1] |= values[i] >> (64 - shift);
+  }
+}
+
+void unpackScalar(const Word *in, size_t count, int width, Word *values) {
+  if (width == 0) {
+    for (size_t i = 0; i < count; i++)
+      values[i] = 0;
+    return;
+  }
+
+  // No branches: the high part of a value crossing the word boundary comes
+  //  from the next word (the padding word at most), and is zero otherwise
+  Word mask = width == 64 ? ~static_cast<Word>(0) : (static_cast<Word>(1) << width) - 1;
+  for (size_t i = 0; i < count; i++) {
+    size_t bit = i * width;
+    size_t word = bit >> 6;
+    int shift = static_cast<int>(bit & 63);
+    Word low = in[word] >> shift;
+    Word high = (in[word + 1] << 1) << (63 - shift);
+    values[i] = (low | high) & mask;
+  }
+}
+
+/** Running sum: out[i] = start + (in[0] + add) + ... + (in[i] + add)
+ */
+void prefixSumScalar(const Word *in, size_t count, Word add, Word start, Word *out) {
+  Word value = start;
+  for (size_t i = 0; i < count; i++) {
+    value += in[i] + add;
+    out[i] = value;
+  }
+}
+
+/** Decoding steps of a block: unpacking residuals and summing them up
+ */
+struct TimelineKernels {
+  CompressedTimeline::Kernel kernel;
+  void (*unpack)(const Word *in, size_t count, int width, Word *values);
+  void (*prefixSum)(const Word *in, size_t count, Word add, Word start, Word *out);
+};
+
+const TimelineKernels SCALAR_KERNELS = {
+  CompressedTimeline::KERNEL_SCALAR, unpackScalar, prefixSumScalar
+};
+
+#ifdef TIMELINE_X86_KERNELS
+//******************************
+// AVX2 kernels: four values per step, gathers fetch the words each value spans
+
+__attribute__((target("avx2")))
+void unpackAvx2(const Word *in, size_t count, int width, Word *values) {
+  if (width == 0) {
+    unpackScalar(in, count, width, values);
+    return;
+  }
+
+  Word mask = width == 64 ? ~static_cast<Word>(0) : (static_cast<Word>(1) << width) - 1;
+  const long long *words = reinterpret_cast<const long long*>(in);
+  __m256i vmask = _mm256_set1_epi64x(static_cast<long long>(mask));
+  __m256i bits = _mm256_setr_epi64x(0, width, 2LL * width, 3LL * width);
+  __m256i step = _mm256_set1_epi64x(4LL * width);
+  __m256i low6 = _mm256_set1_epi64x(63);
+  __m256i one = _mm256_set1_epi64x(1);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m256i word = _mm256_srli_epi64(bits, 6);
+    __m256i shift = _mm256_and_si256(bits, low6);
+    __m256i low = _mm256_i64gather_epi64(words, word, 8);
+    __m256i high = _mm256_i64gather_epi64(words, _mm256_add_epi64(word, one), 8);
+    low = _mm256_srlv_epi64(low, shift);
+    high = _mm256_sllv_epi64(_mm256_slli_epi64(high, 1), _mm256_sub_epi64(low6, shift));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + i),
+      _mm256_and_si256(_mm256_or_si256(low, high), vmask));
+    bits = _mm256_add_epi64(bits, step);
+  }
+
+  // Tail as in unpackScalar()
+  for (; i < count; i++) {
+    size_t bit = i * width;
+    size_t word = bit >> 6;
+    int shift = static_cast<int>(bit & 63);
+    values[i] = ((in[word] >> shift) | ((in[word + 1] << 1) << (63 - shift))) & mask;
+  }
+}
+
+__attribute__((target("avx2")))
+void prefixSumAvx2(const Word *in, size_t count, Word add, Word start, Word *out) {
+  __m256i vadd = _mm256_set1_epi64x(static_cast<long long>(add));
+  __m256i carry = _mm256_set1_epi64x(static_cast<long long>(start));
+  __m256i zero = _mm256_setzero_si256();
+
+  // In-register scan: add the vector shifted by one lane, then by two lanes
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m256i x = _mm256_add_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)), vadd);
+    x = _mm256_add_epi64(x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x03));
+    x = _mm256_add_epi64(x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0x0F));
+    x = _mm256_add_epi64(x, carry);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), x);
+    carry = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3, 3, 3, 3));
+  }
+
+  prefixSumScalar(in + i, count - i, add, i ? out[i - 1] : start, out + i);
+}
+
+const TimelineKernels AVX2_KERNELS = {
+  CompressedTimeline::KERNEL_AVX2, unpackAvx2, prefixSumAvx2
+};
+#endif
+
+const TimelineKernels* bestTimelineKernels(void) {
+#ifdef TIMELINE_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return &AVX2_KERNELS;
+#endif
+  return &SCALAR_KERNELS;
+}
+
+const TimelineKernels* timelineKernels = bestTimelineKernels();
+
+//******************************
+CompressedTimeline::CompressedTimeline() {
+  encode(nullptr, 0);
+}
+
+CompressedTimeline::CompressedTimeline(const DateTime *values, size_t count) {
+  encode(values, count);
+}
+
+CompressedTimeline::CompressedTimeline(const CompressedTimeline &other):
+  m_storage(other.m_storage),
+  m_image(other.m_storage.empty() ? other.m_image : &m_storage[0]),
+  m_words(other.m_words)
+{}
+
+const CompressedTimeline& CompressedTimeline::operator= (const CompressedTimeline &other) {
+  if (this != &other) {
+    m_storage = other.m_storage;
+    m_image = other.m_storage.empty() ? other.m_image : &m_storage[0];
+    m_words = other.m_words;
+  }
+  return *this;
+}
+
+void CompressedTimeline::encode(const DateTime *values, size_t count) {
+  size_t blocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+  m_storage.assign(HEADER_WORDS + blocks * ENTRY_WORDS, 0);
+  m_storage[0] = IMAGE_MAGIC | (IMAGE_VERSION << 32);
+  m_storage[1] = count;
+  m_storage[2] = blocks;
+
+  Word raw[BLOCK_SIZE];
+  Word deltas[BLOCK_SIZE];
+  Word doubles[BLOCK_SIZE];
+
+  for (size_t block = 0; block < blocks; block++) {
+    size_t start = block * BLOCK_SIZE;
+    size_t n = count - start < BLOCK_SIZE ? count - start : BLOCK_SIZE;
+
+    long long least = LLONG_MAX;
+    long long greatest = LLONG_MIN;
+    for (size_t i = 0; i < n; i++) {
+      long long value = values[start + i].getRaw();
+      if (value < least) least = value;
+      if (value > greatest) greatest = value;
+      raw[i] = static_cast<Word>(value);
+    }
+
+    // Differences wrap around for invalid values, that only costs width
+    size_t deltaCount = n - 1;
+    for (size_t i = 1; i < n; i++)
+      deltas[i - 1] = raw[i] - raw[i - 1];
+
+    size_t doubleCount = n > 2 ? n - 2 : 0;
+    for (size_t i = 1; i < deltaCount; i++)
+      doubles[i - 1] = deltas[i] - deltas[i - 1];
+    Word firstDelta = deltaCount ? deltas[0] : 0;
+
+    Word deltaReference, doubleReference;
+    int deltaWidth = makeResiduals(deltas, deltaCount, deltaReference);
+    int doubleWidth = makeResiduals(doubles, doubleCount, doubleReference);
+
+    int mode = MODE_DELTA;
+    if (n > 2 && payloadWords(n, doubleWidth, MODE_DELTA_OF_DELTA) < payloadWords(n, deltaWidth, MODE_DELTA))
+      mode = MODE_DELTA_OF_DELTA;
+    int width = mode == MODE_DELTA ? deltaWidth : doubleWidth;
+
+    size_t offset = m_storage.size();
+    m_storage.resize(offset + payloadWords(n, width, mode), 0);
+
+    Word *entry = &m_storage[HEADER_WORDS + block * ENTRY_WORDS];
+    entry[ENTRY_MIN] = static_cast<Word>(least);
+    entry[ENTRY_MAX] = static_cast<Word>(greatest);
+    entry[ENTRY_OFFSET] = offset;
+    entry[ENTRY_INFO] = makeInfo(n, width, mode);
+
+    Word *payload = &m_storage[offset];
+    payload[0] = raw[0];
+    if (mode == MODE_DELTA) {
+      payload[1] = deltaReference;
+      pack(deltas, deltaCount, width, payload + 2);
+    } else {
+      payload[1] = doubleReference;
+      payload[2] = firstDelta;
+      pack(doubles, doubleCount, width, payload + 3);
+    }
+  }
+
+  m_storage[3] = m_storage.size();
+  m_image = &m_storage[0];
+  m_words = m_storage.size();
+}
+
+CompressedTimeline::Kernel CompressedTimeline::getKernel(void) {
+  return timelineKernels->kernel;
+}
+
+bool CompressedTimeline::setKernel(Kernel kernel) {
+  if (kernel == KERNEL_SCALAR) {
+    timelineKernels = &SCALAR_KERNELS;
+    return true;
+  }
+
+#ifdef TIMELINE_X86_KERNELS
+  if (kernel == KERNEL_AVX2 && __builtin_cpu_supports("avx2")) {
+    timelineKernels = &AVX2_KERNELS;
+    return true;
+  }
+#endif
+
+  return false;
+}
+
+bool CompressedTimeline::attach(const void *data, size_t size) {
+  const Word *image = static_cast<const Word*>(data);
+  size_t words = size / sizeof(Word);
+
+  bool valid = image
+    && size % sizeof(Word) == 0
+    && words >= HEADER_WORDS
+    && image[0] == (IMAGE_MAGIC | (IMAGE_VERSION << 32))
+    && image[3] == words
+    && image[2] <= (words - HEADER_WORDS) / ENTRY_WORDS;
+
+  // Check the directory so that decoding never reads out of the image
+  size_t total = 0;
+  for (size_t block = 0; valid && block < image[2]; block++) {
+    const Word *entry = image + HEADER_WORDS + block * ENTRY_WORDS;
+    size_t count = infoCount(entry[ENTRY_INFO]);
+    int width = infoWidth(entry[ENTRY_INFO]);
+    int mode = infoMode(entry[ENTRY_INFO]);
+
+    // Only the last block may be short: at() relies on that
+    valid = count > 0
+      && (count == BLOCK_SIZE || (count < BLOCK_SIZE && block + 1 == image[2]))
+      && width <= 64
+      && (mode == MODE_DELTA || (mode == MODE_DELTA_OF_DELTA && count > 2))
+      && entry[ENTRY_OFFSET] >= HEADER_WORDS + image[2] * ENTRY_WORDS
+      && entry[ENTRY_OFFSET] <= words
+      && payloadWords(count, width, mode) <= words - entry[ENTRY_OFFSET];
+    total += count;
+  }
+  valid = valid && total == image[1];
+
+  if (!valid) {
+    encode(nullptr, 0);
+    return false;
+  }
+
+  m_storage.clear();
+  m_image = image;
+  m_words = words;
+  return true;
+}
+
+const void* CompressedTimeline::getData(void) const {
+  return m_image;
+}
+
+size_t CompressedTimeline::getDataSize(void) const {
+  return m_words * sizeof(Word);
+}
+
+bool CompressedTimeline::write(std::ostream &stream) const {
+  stream.write(reinterpret_cast<const char*>(m_image), getDataSize());
+  return stream.good();
+}
+
+bool CompressedTimeline::read(std::istream &stream) {
+  vector<Word> image(HEADER_WORDS);
+  stream.read(reinterpret_cast<char*>(&image[0]), HEADER_WORDS * sizeof(Word));
+
+  if (stream.good() && image[3] >= HEADER_WORDS && image[3] < SIZE_MAX / sizeof(Word)) {
+    // The header is not trusted yet: grow the image only as the stream delivers it
+    size_t words = static_cast<size_t>(image[3]);
+    while (image.size() < words && stream.good()) {
+      size_t done = image.size();
+      size_t step = words - done < READ_STEP_WORDS ? words - done : READ_STEP_WORDS;
+      image.resize(done + step);
+      stream.read(reinterpret_cast<char*>(&image[done]), step * sizeof(Word));
+    }
+
+    if (!stream.fail() && attach(&image[0], image.size() * sizeof(Word))) {
+      m_storage.swap(image);
+      m_image = &m_storage[0];
+      return true;
+    }
+  }
+
+  encode(nullptr, 0);
+  return false;
+}
+
+const unsigned long long* CompressedTimeline::entry(size_t block) const {
+  return m_image + HEADER_WORDS + block * ENTRY_WORDS;
+}
+
+size_t CompressedTimeline::size(void) const {
+  return static_cast<size_t>(m_image[1]);
+}
+
+size_t CompressedTimeline::blockCount(void) const {
+  return static_cast<size_t>(m_image[2]);
+}
+
+size_t CompressedTimeline::blockSize(size_t block) const {
+  return infoCount(entry(block)[ENTRY_INFO]);
+}
+
+DateTime CompressedTimeline::blockMin(size_t block) const {
+  DateTime result;
+  result.setRaw(static_cast<long long>(entry(block)[ENTRY_MIN]));
+  return result;
+}
+
+DateTime CompressedTimeline::blockMax(size_t block) const {
+  DateTime result;
+  result.setRaw(static_cast<long long>(entry(block)[ENTRY_MAX]));
+  return result;
+}
+
+size_t CompressedTimeline::decodeBlock(size_t block, DateTime *values) const {
+  const Word *info = entry(block);
+  size_t count = infoCount(info[ENTRY_INFO]);
+  int width = infoWidth(info[ENTRY_INFO]);
+  const Word *payload = m_image + info[ENTRY_OFFSET];
+  Word *raw = reinterpret_cast<Word*>(values);
+
+  Word residuals[BLOCK_SIZE];
+  Word reference = payload[1];
+  raw[0] = payload[0];
+
+  if (infoMode(info[ENTRY_INFO]) == MODE_DELTA) {
+    timelineKernels->unpack(payload + 2, count - 1, width, residuals);
+    timelineKernels->prefixSum(residuals, count - 1, reference, raw[0], raw + 1);
+  } else {
+    // Deltas are a running sum of the residuals, values a running sum of the deltas
+    Word deltas[BLOCK_SIZE];
+    raw[1] = raw[0] + payload[2];
+    timelineKernels->unpack(payload + 3, count - 2, width, residuals);
+    timelineKernels->prefixSum(residuals, count - 2, reference, payload[2], deltas);
+    timelineKernels->prefixSum(deltas, count - 2, 0, raw[1], raw + 2);
+  }
+
+  return count;
+}
+
+DateTime CompressedTimeline::at(size_t index) const {
+  if (index >= size()) return DateTime();
+  DateTime values[BLOCK_SIZE];
+  decodeBlock(index / BLOCK_SIZE, values);
+  return values[index % BLOCK_SIZE];
+}
+
+size_t CompressedTimeline::select(const DateTime &from, const DateTime &to, std::vector<DateTime> &values) const {
+  size_t result = 0;
+  DateTime decoded[BLOCK_SIZE];
+
+  for (size_t block = 0; block < blockCount(); block++) {
+    if (blockMax(block) < from || blockMin(block) >= to) continue;
+
+    size_t count = decodeBlock(block, decoded);
+    for (size_t i = 0; i < count; i++) {
+      if (decoded[i] >= from && decoded[i] < to) {
+        values.push_back(decoded[i]);
+        result++;
+      }
+    }
+  }
+
+  return result;
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <cstddef>
+#include <iostream>
+#include <vector>
+#include "date.h"
+
+/** Compressed sequence of DateTime values
+ *  Values are split into blocks of BLOCK_SIZE. Each block keeps its first
+ *  value and bit-packed differences: either deltas or deltas of deltas
+ *  (whichever packs tighter) stored relative to their minimum.
+ *  Sorted or nearly sorted timestamps take a few bits per value.
+ *
+ *  The encoded image is a flat array of 64-bit words (host byte order):
+ *    header        magic and version, value count, block count
+ *    directory     per block: min, max, payload offset, count/width/mode
+ *    payloads      first value, reference, [first delta], packed bits
+ *  so a file written by write() can be memory-mapped and used with attach()
+ *  without decoding it.
+ *  Blocks are unpacked and summed up by AVX2 kernels chosen at run time
+ *  (GCC/Clang on x86), by scalar loops otherwise.
+ */
+class CompressedTimeline {
+  std::vector<unsigned long long> m_storage;  // owned image, empty if attached
+  const unsigned long long *m_image;
+  size_t m_words;
+
+  const unsigned long long* entry(size_t block) const;
+
+public:
+  /** Amount of values in a block (the last block may be shorter)
+   */
+  static const size_t BLOCK_SIZE = 128;
+
+  /** Decoding kernel sets
+   */
+  enum Kernel {
+    KERNEL_SCALAR,
+    KERNEL_AVX2
+  };
+
+  /** Get kernel set in use
+   */
+  static Kernel getKernel(void);
+
+  /** Use another kernel set (e.g. for testing). Not thread-safe
+   * /result            False if the CPU doesn't support it
+   */
+  static bool setKernel(Kernel kernel);
+
+  /** Construct an empty timeline
+   */
+  CompressedTimeline();
+
+  /** Construct timeline of the values
+   * /param values      Values to compress
+   * /param count       Amount of the values
+   */
+  CompressedTimeline(const DateTime *values, size_t count);
+
+  /** Copy constructor. Attached images stay shared with the source
+   */
+  CompressedTimeline(const CompressedTimeline &other);
+
+  const CompressedTimeline& operator= (const CompressedTimeline &other);
+
+  /** Replace content with the compressed values
+   * /param values      Values to compress
+   * /param count       Amount of the values
+   */
+  void encode(const DateTime *values, size_t count);
+
+  /** Use an encoded image without copying it (e.g. a memory-mapped file)
+   *  The data must be 8-byte aligned and outlive this instance
+   * /param data        Image as produced by write() or getData()
+   * /param size        Image size in bytes
+   * /result            False if the data is not a valid image (the instance becomes empty)
+   */
+  bool attach(const void *data, size_t size);
+
+  /** Get encoded image
+   */
+  const void* getData(void) const;
+
+  /** Get encoded image size in bytes
+   */
+  size_t getDataSize(void) const;
+
+  /** Save encoded image
+   * /result            False on write error
+   */
+  bool write(std::ostream &stream) const;
+
+  /** Load encoded image saved by write()
+   * /result            False on read error or invalid image (the instance becomes empty)
+   */
+  bool read(std::istream &stream);
+
+  /** Get amount of values
+   */
+  size_t size(void) const;
+
+  /** Get amount of blocks
+   */
+  size_t blockCount(void) const;
+
+  /** Get amount of values in a block
+   */
+  size_t blockSize(size_t block) const;
+
+  /** Get the least value of a block
+   */
+  DateTime blockMin(size_t block) const;
+
+  /** Get the greatest value of a block
+   */
+  DateTime blockMax(size_t block) const;
+
+  /** Decode a single block
+   * /param block       Block number
+   * /param values      Accepts up to BLOCK_SIZE values
+   * /result            Amount of values decoded
+   */
+  size_t decodeBlock(size_t block, DateTime *values) const;
+
+  /** Get value by its index
+   *  Decodes the block holding the value
+   */
+  DateTime at(size_t index) const;
+
+  /** Collect values within [from, to) in the stored order
+   *  Blocks entirely out of the range are not decoded
+   * /param from        Range start
+   * /param to          Range end (exclusive)
+   * /param values      Accepts found values
+   * /result            Amount of values appended
+   */
+  size_t select(const DateTime &from, const DateTime &to, std::vector<DateTime> &values) const;
+};
@@ -0,0 +1,119 @@
+#include "stdafx.h"
+#include "timewindow.h"
+#include <climits>
+
+using namespace std;
+
+TimeWindow::TimeWindow(long long bucketMilliseconds, int bucketCount):
+  m_width(bucketMilliseconds > 0 ? bucketMilliseconds : 1)
+{
+  Bucket empty = {LLONG_MIN, 0, 0};
+  m_buckets.assign(bucketCount > 0 ? bucketCount : 1, empty);
+  clear();
+}
+
+long long TimeWindow::keyOf(const DateTime &time) const {
+  // Floor division for the (unlikely) times before the year 1
+  long long raw = time.getRaw();
+  long long key = raw / m_width;
+  if (raw % m_width < 0) key--;
+  return key;
+}
+
+TimeWindow::Bucket& TimeWindow::bucketOf(long long key) {
+  long long size = static_cast<long long>(m_buckets.size());
+  long long index = key % size;
+  if (index < 0) index += size;
+  return m_buckets[static_cast<size_t>(index)];
+}
+
+void TimeWindow::advanceTo(long long key) {
+  if (m_head != LLONG_MIN && key <= m_head) return;
+
+  long long size = static_cast<long long>(m_buckets.size());
+  if (m_head == LLONG_MIN || key - m_head >= size) {
+    // Everything falls out of the window
+    Bucket empty = {LLONG_MIN, 0, 0};
+    m_buckets.assign(m_buckets.size(), empty);
+    m_count = 0;
+    m_sum = 0;
+  } else {
+    // Evict the buckets the window passes
+    for (long long passed = m_head + 1; passed <= key; passed++) {
+      Bucket &bucket = bucketOf(passed);
+      m_count -= bucket.count;
+      m_sum -= bucket.sum;
+      bucket.key = LLONG_MIN;
+      bucket.count = 0;
+      bucket.sum = 0;
+    }
+  }
+
+  m_head = key;
+}
+
+bool TimeWindow::add(const DateTime &time, long long value) {
+  if (!time.isValid()) return false;
+
+  long long key = keyOf(time);
+  advanceTo(key);
+  if (key <= m_head - static_cast<long long>(m_buckets.size())) return false;
+
+  Bucket &bucket = bucketOf(key);
+  bucket.key = key;
+  bucket.count++;
+  bucket.sum += value;
+  m_count++;
+  m_sum += value;
+  return true;
+}
+
+void TimeWindow::advance(const DateTime &now) {
+  if (now.isValid()) advanceTo(keyOf(now));
+}
+
+long long TimeWindow::getCount(void) const {
+  return m_count;
+}
+
+long long TimeWindow::getSum(void) const {
+  return m_sum;
+}
+
+DateTime TimeWindow::getEnd(void) const {
+  DateTime result;
+  if (m_head != LLONG_MIN) result.setRaw(m_head * m_width);
+  return result;
+}
+
+void TimeWindow::mergeBucket(long long key, long long count, long long sum) {
+  advanceTo(key);
+  if (key <= m_head - static_cast<long long>(m_buckets.size())) return;
+
+  Bucket &bucket = bucketOf(key);
+  bucket.key = key;
+  bucket.count += count;
+  bucket.sum += sum;
+  m_count += count;
+  m_sum += sum;
+}
+
+bool TimeWindow::merge(const TimeWindow &other) {
+  if (other.m_width != m_width || other.m_buckets.size() != m_buckets.size()) return false;
+  if (other.m_head == LLONG_MIN) return true;
+
+  advanceTo(other.m_head);
+  for (size_t i = 0; i < other.m_buckets.size(); i++) {
+    const Bucket &source = other.m_buckets[i];
+    if (source.key != LLONG_MIN) mergeBucket(source.key, source.count, source.sum);
+  }
+  return true;
+}
+
+void TimeWindow::clear(void) {
+  Bucket empty = {LLONG_MIN, 0, 0};
+  m_buckets.assign(m_buckets.size(), empty);
+  m_head = LLONG_MIN;
+  m_count = 0;
+  m_sum = 0;
+}
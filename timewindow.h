@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "date.h"
+
+/** Counts and sums of events over a sliding time window
+ *  The window is a ring of fixed-width buckets keyed by truncated m_time,
+ *  running totals make adding and querying O(1) and moving the window
+ *  costs one step per bucket passed. Memory doesn't depend on event rate.
+ *
+ *  Instances are not synchronized: for multi-core ingestion give every
+ *  thread its own TimeWindowShard and merge them into a collector.
+ */
+class TimeWindow {
+  struct Bucket {
+    long long key;      // m_time / width, LLONG_MIN for a never used bucket
+    long long count;
+    long long sum;
+  };
+
+  std::vector<Bucket> m_buckets;
+  long long m_width;
+  long long m_head;     // key of the newest bucket, LLONG_MIN before the first event
+  long long m_count;
+  long long m_sum;
+
+  long long keyOf(const DateTime &time) const;
+  Bucket& bucketOf(long long key);
+  void advanceTo(long long key);
+  void mergeBucket(long long key, long long count, long long sum);
+
+  friend class TimeWindowShard;
+
+public:
+  /** Construct window
+   * /param bucketMilliseconds    Width of a bucket
+   * /param bucketCount           Amount of buckets, the window is their total width
+   */
+  TimeWindow(long long bucketMilliseconds, int bucketCount);
+
+  /** Register an event
+   *  Moves the window forward if the event is newer than its end
+   * /param time        Event time
+   * /param value       Value added to the sum
+   * /result            False for invalid times and events older than the window
+   */
+  bool add(const DateTime &time, long long value = 1);
+
+  /** Move the window so that it ends at the given time
+   *  Earlier times don't move the window back
+   */
+  void advance(const DateTime &now);
+
+  /** Get amount of events in the window
+   */
+  long long getCount(void) const;
+
+  /** Get sum of event values in the window
+   */
+  long long getSum(void) const;
+
+  /** Get time of the window end (start of its newest bucket)
+   * /result            Invalid DateTime before the first event
+   */
+  DateTime getEnd(void) const;
+
+  /** Add events of another window with the same geometry
+   *  This window is moved to the newer end of the two.
+   *  The other window must not change meanwhile (see TimeWindowShard)
+   * /result            False if bucket width or count differ
+   */
+  bool merge(const TimeWindow &other);
+
+  /** Forget all events
+   */
+  void clear(void);
+};
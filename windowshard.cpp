@@ -0,0 +1,76 @@
+#include "stdafx.h"
+#include "windowshard.h"
+#include <climits>
+
+using namespace std;
+
+TimeWindowShard::TimeWindowShard(long long bucketMilliseconds, int bucketCount):
+  m_buckets(bucketCount > 0 ? bucketCount : 1),
+  m_width(bucketMilliseconds > 0 ? bucketMilliseconds : 1),
+  m_head(LLONG_MIN)
+{
+  for (size_t i = 0; i < m_buckets.size(); i++) {
+    m_buckets[i].key.store(LLONG_MIN, memory_order_relaxed);
+    m_buckets[i].count.store(0, memory_order_relaxed);
+    m_buckets[i].sum.store(0, memory_order_relaxed);
+  }
+}
+
+TimeWindowShard::Bucket& TimeWindowShard::bucketOf(long long key) {
+  long long size = static_cast<long long>(m_buckets.size());
+  long long index = key % size;
+  if (index < 0) index += size;
+  return m_buckets[static_cast<size_t>(index)];
+}
+
+bool TimeWindowShard::add(const DateTime &time, long long value) {
+  if (!time.isValid()) return false;
+
+  // Floor division as TimeWindow does
+  long long raw = time.getRaw();
+  long long key = raw / m_width;
+  if (raw % m_width < 0) key--;
+
+  // Only the owner writes, so its own relaxed loads see the latest values
+  long long head = m_head.load(memory_order_relaxed);
+  if (head == LLONG_MIN || key > head) {
+    head = key;
+    m_head.store(head, memory_order_relaxed);
+  }
+  if (key <= head - static_cast<long long>(m_buckets.size())) return false;
+
+  Bucket &bucket = bucketOf(key);
+  if (bucket.key.load(memory_order_relaxed) != key) {
+    // Reuse: readers which see the zeroed totals see the invalid key as well
+    bucket.key.store(LLONG_MIN, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    bucket.count.store(0, memory_order_relaxed);
+    bucket.sum.store(0, memory_order_relaxed);
+    bucket.key.store(key, memory_order_release);
+  }
+  bucket.count.store(bucket.count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+  bucket.sum.store(bucket.sum.load(memory_order_relaxed) + value, memory_order_relaxed);
+  return true;
+}
+
+bool TimeWindowShard::mergeInto(TimeWindow &window) const {
+  if (window.m_width != m_width || window.m_buckets.size() != m_buckets.size()) return false;
+
+  long long head = m_head.load(memory_order_relaxed);
+  if (head == LLONG_MIN) return true;
+  window.advanceTo(head);
+
+  for (size_t i = 0; i < m_buckets.size(); i++) {
+    const Bucket &bucket = m_buckets[i];
+
+    // Totals count only if the key didn't change while reading them
+    long long key = bucket.key.load(memory_order_acquire);
+    long long count = bucket.count.load(memory_order_relaxed);
+    long long sum = bucket.sum.load(memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    if (key == LLONG_MIN || bucket.key.load(memory_order_relaxed) != key) continue;
+
+    window.mergeBucket(key, count, sum);
+  }
+  return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include "date.h"
+#include "timewindow.h"
+
+/** Per-thread part of a TimeWindow for multi-core ingestion
+ *  One thread owns the shard and add()s to it, any other thread may
+ *  mergeInto() a collector at the same time without locks: bucket fields
+ *  are atomics written only by the owner, and a bucket reused for a newer
+ *  key is invalidated first so that readers skip it instead of mixing the
+ *  old and the new totals. A merged bucket may miss the events being added
+ *  at that moment (or have the count of one without its value yet).
+ *
+ *  Collect with a fresh TimeWindow of the same geometry per query:
+ *    TimeWindow total(width, count);
+ *    for (...) shards[i].mergeInto(total);
+ */
+class TimeWindowShard {
+  struct Bucket {
+    std::atomic<long long> key;     // m_time / width, LLONG_MIN while unused or being reset
+    std::atomic<long long> count;
+    std::atomic<long long> sum;
+  };
+
+  std::vector<Bucket> m_buckets;
+  long long m_width;
+  std::atomic<long long> m_head;    // key of the newest bucket, LLONG_MIN before the first event
+
+  TimeWindowShard(const TimeWindowShard&);
+  const TimeWindowShard& operator= (const TimeWindowShard&);
+
+  Bucket& bucketOf(long long key);
+
+public:
+  /** Construct shard
+   * /param bucketMilliseconds    Width of a bucket
+   * /param bucketCount           Amount of buckets, the window is their total width
+   */
+  TimeWindowShard(long long bucketMilliseconds, int bucketCount);
+
+  /** Register an event. Owner thread only
+   *  Moves the shard window forward if the event is newer than its end
+   * /param time        Event time
+   * /param value       Value added to the sum
+   * /result            False for invalid times and events older than the window
+   */
+  bool add(const DateTime &time, long long value = 1);
+
+  /** Add events of the shard to a window with the same geometry
+   *  May run concurrently with add()
+   * /result            False if bucket width or count differ
+   */
+  bool mergeInto(TimeWindow &window) const;
+};